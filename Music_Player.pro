@@ -3,13 +3,41 @@ CONFIG += console c++20
 CONFIG -= app_bundle
 CONFIG -= qt
 
+# Uncomment below line to profile the contention and hold time of the mutexes.
+#DEFINES += MUTEX_PROFILING
+
+# Uncomment below line to compute the FFT of the spectrum visualizer with AVX (SSE is used otherwise).
+#QMAKE_CXXFLAGS += -mavx
+
 SOURCES += \
+        audiorenderer.cpp \
+        controlserver.cpp \
         displayplaylist.cpp \
+        fft.cpp \
+        logcodec.cpp \
 	logger.cpp\
+        loudness.cpp \
         main.cpp \
-        song.cpp
+        playerclock.cpp \
+        profiledmutex.cpp \
+        seektable.cpp \
+        song.cpp \
+        spectrumvisualizer.cpp
 
 HEADERS += \
+    audiorenderer.h \
+    controlprotocol.h \
+    controlserver.h \
     displayplaylist.h \
+    fft.h \
+    logcodec.h \
     logger.h \
-    song.h
+    loudness.h \
+    playerclock.h \
+    profiledmutex.h \
+    ringqueue.h \
+    seektable.h \
+    snapshotbuffer.h \
+    song.h \
+    spectrumvisualizer.h \
+    spscqueue.h
@@ -0,0 +1,24 @@
+TEMPLATE = app
+CONFIG += console c++20
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        ../audiorenderer.cpp \
+        ../displayplaylist.cpp \
+        ../logcodec.cpp \
+        ../logger.cpp \
+        ../loudness.cpp \
+        ../playerclock.cpp \
+        ../profiledmutex.cpp \
+        ../seektable.cpp \
+        ../song.cpp \
+        main.cpp
+
+HEADERS += \
+    ../displayplaylist.h \
+    ../logger.h \
+    ../ringqueue.h \
+    ../song.h
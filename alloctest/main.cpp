@@ -0,0 +1,147 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include "displayplaylist.h"
+#include "song.h"
+#include "logger.h"
+#include "playerclock.h"
+
+using namespace std;
+
+/* counting is true while the checked code runs, every allocation meanwhile is counted. */
+static atomic<bool> counting(false);
+static atomic<unsigned long> allocations(0);
+
+/* ============= COUNTING ALLOCATOR ==============*/
+static void* allocate(size_t size, size_t alignment)
+{
+    if(counting.load(memory_order_relaxed))
+        allocations.fetch_add(1, memory_order_relaxed);
+    void *memory = alignment <= alignof(max_align_t) ? malloc(size ? size : 1)
+                                                    : aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if(memory == NULL)
+        throw bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size){ return allocate(size, alignof(max_align_t)); }
+void* operator new[](size_t size){ return allocate(size, alignof(max_align_t)); }
+void* operator new(size_t size, align_val_t alignment){ return allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, align_val_t alignment){ return allocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete[](void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t) noexcept { free(memory); }
+void operator delete(void *memory, align_val_t) noexcept { free(memory); }
+void operator delete[](void *memory, align_val_t) noexcept { free(memory); }
+void operator delete(void *memory, size_t, align_val_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t, align_val_t) noexcept { free(memory); }
+
+/*****************************************************************************************************//**
+ * @brief check runs the code with the allocations counted, and displays the result.
+ * @param name of the checked path.
+ * @param code to run.
+ * @return true if the code did not allocate.
+ ********************************************************************************************************/
+template <typename Code>
+bool check(const char *name, Code code)
+{
+    allocations = 0;
+    counting = true;
+    code();
+    counting = false;
+    unsigned long counted = allocations.load();
+    printf("%-42s %s (%lu allocations)\n", name, counted == 0 ? "PASS" : "FAIL", counted);
+    return counted == 0;
+}
+
+/*****************************************************************************************************//**
+ * @brief main method of the alloctest, which checks that the hot paths of the player never allocate.
+ *
+ * `operator new` is replaced by a counting allocator, and the steady state of each path is run
+ * after a warm up (the thread local log buffer, the `FILE` buffer and the interned strings are created once).\n
+ * Checked paths:
+ * 1. logging with `LOGF()`.
+ * 2. moving songs into the playlist with `DisplayPlaylist::pushSongIntoPlaylist(Song&&)`.
+ * 3. constructing songs in the playlist with `DisplayPlaylist::emplaceSongIntoPlaylist()`.
+ * 4. playing the whole playlist on a [VirtualClock](@ref VirtualClock), with the player threads
+ *    (`playPlaylist()`, `playNextSong()` and `monitorException()`) created before and released while counting.
+ * .
+ * @return 0 if no checked path allocates, else returns 1.
+ ********************************************************************************************************/
+int main()
+{
+    const size_t totalSongs = 1000;
+    Logger::get()->disableConsoleOutput();
+    Logger::get()->setFilename("alloctest.log");
+    Logger::get()->setPriority(trace);
+
+    string name = "Shape of You", thumbnailPath = "/thumbnails/shape_of_you.jpeg";
+    vector<Song> songs;
+    songs.reserve(totalSongs);
+    for(size_t i=0; i<totalSongs; i++)
+        songs.emplace_back(name, chrono::seconds(240), thumbnailPath);
+
+    bool passed = true;
+    {
+        DisplayPlaylist playlist;
+        playlist.disableScreenOutput();
+        playlist.reservePlaylist(2*totalSongs);
+        LOGF(debug, "warm up, song id: %u", songs.front().getId());
+
+        passed &= check("LOGF", [&](){
+            for(size_t i=0; i<totalSongs; i++)
+                LOGF(debug, "Song Playing id: %u, name: %.*s", songs[i].getId(), (int)name.size(), name.data());
+        });
+        passed &= check("DisplayPlaylist::pushSongIntoPlaylist(&&)", [&](){
+            for(Song &song : songs)
+                playlist.pushSongIntoPlaylist(std::move(song));
+        });
+        passed &= check("DisplayPlaylist::emplaceSongIntoPlaylist", [&](){
+            for(size_t i=0; i<totalSongs; i++)
+                playlist.emplaceSongIntoPlaylist(name, chrono::seconds(240), thumbnailPath);
+        });
+    }
+    {
+        VirtualClock clock;
+        Logger::get()->setClock(&clock);
+        DisplayPlaylist playlist(&clock);
+        playlist.disableScreenOutput();
+        playlist.reservePlaylist(totalSongs);
+        for(size_t i=0; i<totalSongs; i++)
+            playlist.emplaceSongIntoPlaylist(name, chrono::seconds(240), thumbnailPath);
+
+        // creating a thread allocates, so the threads are created first, and wait (after their first log) for the check.
+        atomic<bool> released(false);
+        int returnValue = 1;
+        auto player = [&](auto body){
+            return thread([&, body](){
+                LOG(debug, "warm up"); // thread local buffers of the logger
+                while(!released)
+                    this_thread::yield();
+                body();
+            });
+        };
+        thread t_playSongs = player([&](){ playlist.playPlaylist(); });
+        thread t_monitorException = player([&](){ playlist.monitorException(returnValue); });
+        thread t_changeSong = player([&](){ playlist.playNextSong(); });
+
+        passed &= check("DisplayPlaylist::playPlaylist (virtual)", [&](){
+            released = true;
+            t_playSongs.join();
+            t_changeSong.join();
+            t_monitorException.join();
+        });
+        // all the songs must be played, else the check would pass by doing nothing.
+        passed &= returnValue == 0 && playlist.getPendingSongs() == 0 && clock.elapsed() >= chrono::seconds(240) * totalSongs;
+        Logger::get()->setClock(NULL);
+    }
+
+    delete Logger::get();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+#include "audiorenderer.h"
+#include <cmath>
+#include <cstring>
+#include <pthread.h>
+#include <time.h>      // for clock_nanosleep()
+#include <cerrno>
+#include <sys/mman.h>  // for mlock()
+
+using namespace std;
+using namespace std::chrono;
+
+/* ============= SOURCES & OUTPUTS ==============*/
+AudioSource::~AudioSource(){}
+
+ToneSource::ToneSource(const double frequency, const nanoseconds &duration, const unsigned int sampleRate)
+{
+    this->step = 2*M_PI*frequency/sampleRate;
+    this->totalFrames = duration.count() * sampleRate / 1000000000LL;
+    this->position = 0;
+}
+
+size_t ToneSource::read(float *buffer, const size_t frames, const unsigned int channels)
+{
+    size_t count = 0;
+    for(; count < frames && position < totalFrames; count++, position++){
+        float sample = 0.5f * static_cast<float>(sin(step * position));
+        for(unsigned int channel=0; channel<channels; channel++)
+            buffer[count*channels + channel] = sample;
+    }
+    return count;
+}
+
+void ToneSource::seek(const unsigned long long frame){
+    position = frame < totalFrames ? frame : totalFrames;
+}
+
+AudioOutput::~AudioOutput(){}
+
+void AudioOutput::write(const float *, const size_t, const unsigned int){}
+
+
+/* ========== CONSTRUCTOR - DESTRUCTOR ===========*/
+AudioRenderer::AudioRenderer(const unsigned int sampleRate, const unsigned int channels, const size_t periodFrames, PlayerClock *clock)
+{
+    this->sampleRate = sampleRate;
+    this->channels = channels;
+    this->periodFrames = periodFrames;
+    this->clock = clock;
+    this->output = &defaultOutput;
+
+    // resize() writes every sample, so all the pages are faulted in before the render thread starts.
+    buffer.resize(periodFrames * channels);
+    mlock(buffer.data(), buffer.size() * sizeof(float)); // best effort, may fail without privileges
+    history.resize(SNAPSHOT_SIZE);
+    historyPosition = 0;
+    mlock(history.data(), history.size() * sizeof(float));
+    mlock(&snapshots, sizeof(snapshots));
+
+    running = false;
+    state = STOPPED;
+    source = NULL;
+    position = 0;
+    volume = 1.0f;
+    finishedSongs = 0;
+    periods = 0;
+    underruns = 0;
+    maxLateness = 0;
+    realTimePriority = false;
+}
+
+AudioRenderer::~AudioRenderer(){
+    stop();
+    munlock(buffer.data(), buffer.size() * sizeof(float));
+    munlock(history.data(), history.size() * sizeof(float));
+    munlock(&snapshots, sizeof(snapshots));
+}
+
+
+/* ============= THREAD ==============*/
+void AudioRenderer::setOutput(AudioOutput *output){
+    this->output = (output != NULL) ? output : &defaultOutput;
+}
+
+bool AudioRenderer::start(const bool realTimePriority)
+{
+    if(renderThread.joinable())
+        return this->realTimePriority;
+
+    running = true;
+    renderThread = thread(&AudioRenderer::render, this);
+
+    if(realTimePriority){
+        sched_param parameter;
+        parameter.sched_priority = sched_get_priority_max(SCHED_FIFO) - 10;
+        this->realTimePriority = pthread_setschedparam(renderThread.native_handle(), SCHED_FIFO, &parameter) == 0;
+        return this->realTimePriority;
+    }
+    return true;
+}
+
+void AudioRenderer::stop()
+{
+    running = false;
+    if(renderThread.joinable())
+        renderThread.join();
+    state = STOPPED;
+    source = NULL;
+}
+
+void AudioRenderer::render()
+{
+    // touch the stack which the render loop may use, so that it doesn't page fault later.
+    // written through the volatile array (one byte per page is enough), so the stores are not optimized away.
+    volatile char stack[32*1024];
+    for(size_t i=0; i<sizeof(stack); i+=4096)
+        stack[i] = 0;
+
+    const nanoseconds period(periodFrames * 1000000000LL / sampleRate);
+
+    // deadlines are taken from the monotonic clock, so a change of the wall clock (NTP, manual) can not cause
+    // bogus underruns or long sleeps. Only an injected clock other than RealClock (simulation) is followed instead.
+    const bool monotonic = dynamic_cast<RealClock*>(clock) != NULL;
+    auto currentTime = [&]() -> nanoseconds {
+        return monotonic ? duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+                         : duration_cast<nanoseconds>(clock->now().time_since_epoch());
+    };
+    nanoseconds deadline = currentTime() + period;
+
+    while(running)
+    {
+        TransportCommand command;
+        while(commands.pop(command))
+            apply(command);
+
+        // ---------- render one period ----------
+        size_t rendered = 0;
+        AudioSource *current = source.load(memory_order_relaxed);
+        if(state.load(memory_order_relaxed) == PLAYING && current != NULL){
+            rendered = current->read(buffer.data(), periodFrames, channels);
+            float gain = volume.load(memory_order_relaxed);
+            for(size_t i=0; i < rendered*channels; i++)
+                buffer[i] *= gain;
+            position.fetch_add(rendered, memory_order_relaxed);
+
+            if(rendered < periodFrames){ // song is finished
+                source.store(NULL, memory_order_release);
+                state.store(STOPPED, memory_order_release);
+                finishedSongs.fetch_add(1, memory_order_release);
+            }
+        }
+        fill(buffer.begin() + rendered*channels, buffer.end(), 0.0f);
+        output->write(buffer.data(), periodFrames, channels);
+        publishSnapshot();
+        periods.fetch_add(1, memory_order_relaxed);
+
+        // ---------- wait for the next period ----------
+        nanoseconds now = currentTime();
+        if(now > deadline){
+            long long lateness = (now - deadline).count();
+            underruns.fetch_add(1, memory_order_relaxed);
+            if(lateness > maxLateness.load(memory_order_relaxed))
+                maxLateness.store(lateness, memory_order_relaxed);
+            deadline = now; // resynchronize instead of rendering the missed periods in a burst
+        }
+        else if(monotonic){
+            // absolute wake up time, so the time spent rendering does not shift the next periods.
+            timespec wakeUp = {static_cast<time_t>(deadline.count() / 1000000000LL), static_cast<long>(deadline.count() % 1000000000LL)};
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeUp, NULL) == EINTR);
+        }
+        else
+            clock->sleepFor(deadline - now);
+        deadline += period;
+    }
+}
+
+void AudioRenderer::publishSnapshot()
+{
+    // only the last SNAPSHOT_SIZE frames of a long period can remain in the history
+    size_t first = periodFrames > SNAPSHOT_SIZE ? periodFrames - SNAPSHOT_SIZE : 0;
+    const float scale = 1.0f / channels;
+    for(size_t frame=first; frame<periodFrames; frame++){
+        float sample = 0.0f;
+        for(unsigned int channel=0; channel<channels; channel++)
+            sample += buffer[frame*channels + channel];
+        history[historyPosition] = sample * scale;
+        historyPosition = (historyPosition + 1) % SNAPSHOT_SIZE;
+    }
+
+    // unroll the ring, so that the snapshot is oldest first
+    Snapshot &snapshot = snapshots.back();
+    size_t tail = SNAPSHOT_SIZE - historyPosition;
+    memcpy(snapshot.data(), history.data() + historyPosition, tail * sizeof(float));
+    memcpy(snapshot.data() + tail, history.data(), historyPosition * sizeof(float));
+    snapshots.publish();
+}
+
+void AudioRenderer::apply(const TransportCommand &command)
+{
+    switch(command.type){
+        case TransportCommand::LOAD:
+            source.store(command.source, memory_order_release);
+            position.store(0, memory_order_relaxed);
+            state.store(STOPPED, memory_order_release);
+            break;
+        case TransportCommand::PLAY:
+            if(source.load(memory_order_relaxed) != NULL)
+                state.store(PLAYING, memory_order_release);
+            break;
+        case TransportCommand::PAUSE:
+            if(state.load(memory_order_relaxed) == PLAYING)
+                state.store(PAUSED, memory_order_release);
+            break;
+        case TransportCommand::SKIP:
+            if(source.load(memory_order_relaxed) != NULL){
+                source.store(NULL, memory_order_release);
+                state.store(STOPPED, memory_order_release);
+                finishedSongs.fetch_add(1, memory_order_release);
+            }
+            break;
+        case TransportCommand::SEEK:
+            if(AudioSource *current = source.load(memory_order_relaxed)){
+                current->seek(command.frame);
+                position.store(command.frame, memory_order_relaxed);
+            }
+            break;
+        case TransportCommand::VOLUME:
+            volume.store(command.volume, memory_order_relaxed);
+            break;
+    }
+}
+
+
+/* ============= TRANSPORT COMMANDS ==============*/
+bool AudioRenderer::post(const TransportCommand &command){
+    return commands.push(command);
+}
+
+bool AudioRenderer::load(AudioSource *source){
+    return post({TransportCommand::LOAD, source, 0, 0.0f});
+}
+
+bool AudioRenderer::play(){
+    return post({TransportCommand::PLAY, NULL, 0, 0.0f});
+}
+
+bool AudioRenderer::pause(){
+    return post({TransportCommand::PAUSE, NULL, 0, 0.0f});
+}
+
+bool AudioRenderer::skip(){
+    return post({TransportCommand::SKIP, NULL, 0, 0.0f});
+}
+
+bool AudioRenderer::seek(const unsigned long long frame){
+    return post({TransportCommand::SEEK, NULL, frame, 0.0f});
+}
+
+bool AudioRenderer::setVolume(const float volume){
+    return post({TransportCommand::VOLUME, NULL, 0, volume});
+}
+
+
+/* ============= PUBLISHED STATE ==============*/
+AudioRenderer::State AudioRenderer::getState() const { return state.load(memory_order_acquire); }
+AudioSource* AudioRenderer::getSource() const { return source.load(memory_order_acquire); }
+unsigned long long AudioRenderer::getPosition() const { return position.load(memory_order_relaxed); }
+float AudioRenderer::getVolume() const { return volume.load(memory_order_relaxed); }
+unsigned long long AudioRenderer::getFinishedSongs() const { return finishedSongs.load(memory_order_acquire); }
+unsigned long long AudioRenderer::getPeriods() const { return periods.load(memory_order_relaxed); }
+unsigned long long AudioRenderer::getUnderruns() const { return underruns.load(memory_order_relaxed); }
+nanoseconds AudioRenderer::getMaxLateness() const { return nanoseconds(maxLateness.load(memory_order_relaxed)); }
+bool AudioRenderer::isRealTimePriority() const { return realTimePriority.load(); }
+unsigned int AudioRenderer::getSampleRate() const { return sampleRate; }
+
+const AudioRenderer::Snapshot& AudioRenderer::readSnapshot(bool &updated){
+    return snapshots.read(updated);
+}
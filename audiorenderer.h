@@ -0,0 +1,321 @@
+#ifndef AUDIORENDERER_H
+#define AUDIORENDERER_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <array>
+#include "spscqueue.h"
+#include "snapshotbuffer.h"
+#include "playerclock.h"
+
+
+/*********************************************************************************************//**
+ * @class AudioSource
+ * @brief AudioSource is the interface of the audio data played by the [AudioRenderer](@ref AudioRenderer).
+ *
+ * Its methods are called from the render thread, so they must not lock, allocate or log.
+ ************************************************************************************************/
+class AudioSource
+{
+public:
+
+    /** @brief ~AudioSource virtual destructor. */
+    virtual ~AudioSource();
+
+    /*****************************************************************************************//**
+     * @brief read renders the next frames of the song.
+     * @param buffer is filled with `frames` interleaved frames of `channels` samples.
+     * @param frames is the number of frames to render.
+     * @param channels is the number of samples per frame.
+     * @return number of frames rendered, less than `frames` means the song is finished.
+     ********************************************************************************************/
+    virtual size_t read(float *buffer, const size_t frames, const unsigned int channels) = 0;
+
+    /*************************************************************//**
+     * @brief seek moves the read position of the source.
+     * @param frame is the new position in frames.
+     ****************************************************************/
+    virtual void seek(const unsigned long long frame) = 0;
+};
+
+
+/*************************************************************************************//**
+ * @class ToneSource
+ * @brief ToneSource is a sine wave of a fixed length, used to test the render thread.
+ ****************************************************************************************/
+class ToneSource : public AudioSource
+{
+public:
+
+    /*************************************************************//**
+     * @brief ToneSource constructor.
+     * @param frequency of the tone in Hz.
+     * @param duration of the tone.
+     * @param sampleRate is the number of frames per second.
+     ****************************************************************/
+    ToneSource(const double frequency, const std::chrono::nanoseconds &duration, const unsigned int sampleRate);
+
+    size_t read(float *buffer, const size_t frames, const unsigned int channels) override;
+    void seek(const unsigned long long frame) override;
+
+private:
+
+    /** @brief phase increment per frame (2*pi*frequency/sampleRate). */
+    double step;
+
+    /** @brief totalFrames is the length of the tone. */
+    unsigned long long totalFrames;
+
+    /** @brief position is the next frame to render. */
+    unsigned long long position;
+};
+
+
+/*********************************************************************************************//**
+ * @class AudioOutput
+ * @brief AudioOutput is the interface of the sound device, to which the rendered periods are written.
+ *
+ * Default output discards the audio, the render thread still keeps the timing of a real device.
+ ************************************************************************************************/
+class AudioOutput
+{
+public:
+
+    /** @brief ~AudioOutput virtual destructor. */
+    virtual ~AudioOutput();
+
+    /*****************************************************************************//**
+     * @brief write plays one period of interleaved frames (called from the render thread).
+     * @param buffer contains `frames` interleaved frames.
+     * @param frames is the number of frames in the period.
+     * @param channels is the number of samples per frame.
+     ********************************************************************************/
+    virtual void write(const float *buffer, const size_t frames, const unsigned int channels);
+};
+
+
+/*********************************************************************************//**
+ * @struct TransportCommand
+ * @brief TransportCommand is a command sent to the render thread through the command queue.
+ ************************************************************************************/
+struct TransportCommand
+{
+    /** @brief Type of the transport command. */
+    enum Type { LOAD, PLAY, PAUSE, SKIP, SEEK, VOLUME };
+
+    /** @brief type of the command. */
+    Type type;
+
+    /** @brief source to play, used by `LOAD`. */
+    AudioSource *source;
+
+    /** @brief frame to seek, used by `SEEK`. */
+    unsigned long long frame;
+
+    /** @brief volume (gain), used by `VOLUME`. */
+    float volume;
+};
+
+
+/***************************************************************************************************************//**
+ * @class AudioRenderer
+ * @brief AudioRenderer renders the audio on a dedicated real-time thread.
+ *
+ * The render thread wakes up once per period, applies the pending transport commands, reads one period from
+ * the [AudioSource](@ref AudioSource), applies the volume and writes it into the [AudioOutput](@ref AudioOutput).\n
+ * The render thread never locks, allocates or logs:
+ * 1. commands (load/play/pause/skip/seek/volume) arrive through a lock-free [SpscQueue](@ref SpscQueue).
+ * 2. state, position, volume and the counters are published back through atomics.
+ * 3. the period buffer is allocated, pre-faulted and locked in memory before the thread starts.
+ * .
+ * If a period is completed after its deadline, it is counted as an underrun, so `getUnderruns()`
+ * proves whether the thread has ever missed a deadline.\n
+ * After every period, the last `SNAPSHOT_SIZE` played samples (mixed down to mono) are published through a
+ * lock-free [SnapshotBuffer](@ref SnapshotBuffer), for the visualizers (see `readSnapshot()`).\n
+ * Commands must be sent from a single control thread, since the queue has a single producer.\n
+ * A source given to `load()` must remain alive until `getSource()` returns another source, or the renderer is stopped.
+ ******************************************************************************************************************/
+class AudioRenderer
+{
+public:
+
+    /** @brief State of the playback. */
+    enum State { STOPPED, PLAYING, PAUSED };
+
+    /** @brief number of the samples in a snapshot of the played audio. */
+    static const size_t SNAPSHOT_SIZE = 2048;
+
+    /** @brief Snapshot is the last `SNAPSHOT_SIZE` played samples, mixed down to mono, oldest first. */
+    typedef std::array<float, SNAPSHOT_SIZE> Snapshot;
+
+    /*************************************************************************************//**
+     * @brief AudioRenderer constructor allocates and pre-faults the period buffer.
+     * @param sampleRate is the number of frames per second (default 48000).
+     * @param channels is the number of samples per frame (default 2).
+     * @param periodFrames is the number of frames rendered at once (default 256).
+     * @param clock is the real time clock (default), or a simulated clock to follow instead of the monotonic clock.
+     ****************************************************************************************/
+    AudioRenderer(const unsigned int sampleRate = 48000,
+                  const unsigned int channels = 2,
+                  const size_t periodFrames = 256,
+                  PlayerClock *clock = PlayerClock::realTime());
+
+    /** @brief ~AudioRenderer stops the render thread. */
+    ~AudioRenderer();
+
+    AudioRenderer(const AudioRenderer &) = delete;
+    AudioRenderer& operator= (const AudioRenderer &) = delete;
+
+    /** @brief sets the output device, must be called before `start()` (default output discards the audio). */
+    void setOutput(AudioOutput *output);
+
+    /***************************************************************************************//**
+     * @brief start creates the render thread.
+     * @param realTimePriority requests `SCHED_FIFO` scheduling for the render thread (default `false`).
+     * @return false if the real time priority was requested but not granted (thread still runs).
+     ******************************************************************************************/
+    bool start(const bool realTimePriority = false);
+
+    /** @brief stop stops and joins the render thread. */
+    void stop();
+
+    /*******************************************************************//**
+     * @name Transport commands
+     * Commands are queued for the render thread, and return false if the queue is full.
+     **********************************************************************/
+    ///@{
+    bool load(AudioSource *source);
+    bool play();
+    bool pause();
+    bool skip();
+    bool seek(const unsigned long long frame);
+    bool setVolume(const float volume);
+    ///@}
+
+    /** @brief current state of the playback. */
+    State getState() const;
+
+    /** @brief current source, or `NULL` if nothing is loaded. */
+    AudioSource* getSource() const;
+
+    /** @brief position of the current source, in frames. */
+    unsigned long long getPosition() const;
+
+    /** @brief current volume (gain). */
+    float getVolume() const;
+
+    /** @brief number of the sources played till end or skipped. */
+    unsigned long long getFinishedSongs() const;
+
+    /** @brief number of the periods rendered. */
+    unsigned long long getPeriods() const;
+
+    /** @brief number of the periods completed after their deadline. */
+    unsigned long long getUnderruns() const;
+
+    /** @brief maximum lateness of a period after its deadline. */
+    std::chrono::nanoseconds getMaxLateness() const;
+
+    /** @brief whether the render thread runs with `SCHED_FIFO` priority or not. */
+    bool isRealTimePriority() const;
+
+    /** @brief sample rate of the renderer. */
+    unsigned int getSampleRate() const;
+
+    /***************************************************************************************//**
+     * @brief readSnapshot returns the latest snapshot of the played audio, without locking.
+     *
+     * It must be called from a single thread (i.e. the visualizer thread).
+     * @param updated is set to true if a new snapshot is published since the last call.
+     * @return reference to the snapshot, valid until the next call.
+     ******************************************************************************************/
+    const Snapshot& readSnapshot(bool &updated);
+
+private:
+
+    /** @brief render is the body of the render thread. */
+    void render();
+
+    /** @brief applies one transport command, called from the render thread. */
+    void apply(const TransportCommand &command);
+
+    /** @brief appends the period to the `history` and publishes a snapshot, called from the render thread. */
+    void publishSnapshot();
+
+    /** @brief sends the command to the render thread. */
+    bool post(const TransportCommand &command);
+
+    /** @brief number of frames per second. */
+    unsigned int sampleRate;
+
+    /** @brief number of samples per frame. */
+    unsigned int channels;
+
+    /** @brief number of frames rendered at once. */
+    size_t periodFrames;
+
+    /** @brief clock is followed for the deadlines of the periods if it is not a [RealClock](@ref RealClock), else they are monotonic. */
+    PlayerClock *clock;
+
+    /** @brief output is the device to which the periods are written. */
+    AudioOutput *output;
+
+    /** @brief defaultOutput is used if no output is set. */
+    AudioOutput defaultOutput;
+
+    /** @brief buffer is the pre-faulted period buffer, used only by the render thread. */
+    std::vector<float> buffer;
+
+    /** @brief history is the ring of the last `SNAPSHOT_SIZE` played samples (mono), used only by the render thread. */
+    std::vector<float> history;
+
+    /** @brief historyPosition is the index of the oldest sample in `history`. */
+    size_t historyPosition;
+
+    /** @brief snapshots publishes the `history` to the reader of `readSnapshot()`. */
+    SnapshotBuffer<Snapshot> snapshots;
+
+    /** @brief commands is the queue of transport commands from the control thread. */
+    SpscQueue<TransportCommand, 64> commands;
+
+    /** @brief renderThread runs `render()`. */
+    std::thread renderThread;
+
+    /** @brief running is true until the renderer is asked to stop. */
+    std::atomic<bool> running;
+
+    /*
+     * Below members are written only by the render thread (except in constructor and stop()),
+     * and are published to the other threads through atomics.
+     */
+
+    /** @brief state of the playback. */
+    std::atomic<State> state;
+
+    /** @brief source being played. */
+    std::atomic<AudioSource*> source;
+
+    /** @brief position of the source in frames. */
+    std::atomic<unsigned long long> position;
+
+    /** @brief volume is the gain applied to the samples. */
+    std::atomic<float> volume;
+
+    /** @brief number of the sources played till end or skipped. */
+    std::atomic<unsigned long long> finishedSongs;
+
+    /** @brief number of the periods rendered. */
+    std::atomic<unsigned long long> periods;
+
+    /** @brief number of the periods completed after their deadline. */
+    std::atomic<unsigned long long> underruns;
+
+    /** @brief maximum lateness (in nanoseconds) of a period after its deadline. */
+    std::atomic<long long> maxLateness;
+
+    /** @brief realTimePriority is true if `SCHED_FIFO` was granted to the render thread. */
+    std::atomic<bool> realTimePriority;
+};
+
+#endif // AUDIORENDERER_H
@@ -0,0 +1,141 @@
+#ifndef CONTROLPROTOCOL_H
+#define CONTROLPROTOCOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+
+/*************************************************************************************************************//**
+ * @namespace ControlProtocol
+ * @brief ControlProtocol is the binary protocol between the [ControlServer](@ref ControlServer) and its clients.
+ *
+ * Every message is a `Header` followed by `Header::length` bytes of body.
+ * All the integers are in the byte order of the host (the socket is local).\n
+ * Requests and their replies:
+ * 1. `ENQUEUE` (body `EnqueueRequest` + name + thumbnail path + audio path) is replied by `ENQUEUED` (`EnqueueReply`),
+ *    or by `ERROR` with `PLAYLIST_FULL` if too many songs are waiting,
+ *    or with `FORBIDDEN_PATH` if the audio path is not inside the library of the server.
+ * 2. `STATUS` (no body) is replied by `STATUS_REPLY` (`StatusReply` + name of the song).
+ * 3. `SUBSCRIBE` / `UNSUBSCRIBE` (no body) are replied by `SUBSCRIBED` / `UNSUBSCRIBED` (no body).
+ * 4. an invalid request is replied by `ERROR`, with the error in `Header::status`.
+ * .
+ * The reply has the `sequence` of its request, so a client can pipeline the requests.\n
+ * Subscribed clients also receive `EVENT` messages (`Event` + name of the song) with sequence 0.
+ ****************************************************************************************************************/
+namespace ControlProtocol
+{
+    /** @brief maximum length of the body of a message. */
+    const uint16_t MAX_BODY = 1024;
+
+    /** @brief names are truncated to this length in the replies and events. */
+    const uint16_t MAX_NAME = 256;
+
+    /** @brief Type of the message. */
+    enum Type : uint8_t {
+        ENQUEUE = 1, STATUS = 2, SUBSCRIBE = 3, UNSUBSCRIBE = 4,
+        ENQUEUED = 0x81, STATUS_REPLY = 0x82, SUBSCRIBED = 0x83, UNSUBSCRIBED = 0x84,
+        EVENT = 0x90, ERROR = 0xFF
+    };
+
+    /** @brief Status of the reply. */
+    enum Status : uint8_t { OK = 0, BAD_REQUEST = 1, UNKNOWN_TYPE = 2, PLAYLIST_FULL = 3, FORBIDDEN_PATH = 4 };
+
+    /** @brief EventKind tells what happened to the song. */
+    enum EventKind : uint8_t { SONG_STARTED = 1, SONG_FINISHED = 2 };
+
+    /** @brief Header of every message. */
+    struct Header {
+        /** @brief length of the body. */
+        uint16_t length;
+        /** @brief `Type` of the message. */
+        uint8_t type;
+        /** @brief `Status` of the reply, 0 in the requests. */
+        uint8_t status;
+        /** @brief sequence of the request, copied into its reply. */
+        uint32_t sequence;
+    };
+
+    /** @brief body of `ENQUEUE`, followed by the strings. */
+    struct EnqueueRequest {
+        /** @brief duration of the song in seconds. */
+        uint32_t duration;
+        /** @brief length of the name. */
+        uint16_t nameLength;
+        /** @brief length of the thumbnail path. */
+        uint16_t thumbnailLength;
+        /** @brief length of the audio path. */
+        uint16_t audioLength;
+        /** @brief unused, 0. */
+        uint16_t reserved;
+    };
+
+    /** @brief body of `ENQUEUED`. */
+    struct EnqueueReply {
+        /** @brief id given to the song. */
+        uint32_t songId;
+        /** @brief number of the songs which are not started yet. */
+        uint32_t pending;
+    };
+
+    /** @brief body of `STATUS_REPLY`, followed by the name of the song. */
+    struct StatusReply {
+        /** @brief id of the song being played (or the last played song). */
+        uint32_t songId;
+        /** @brief duration of the song in seconds. */
+        uint32_t duration;
+        /** @brief number of the songs which are not started yet. */
+        uint32_t pending;
+        /** @brief 1 if the song is being played. */
+        uint8_t playing;
+        /** @brief unused, 0. */
+        uint8_t reserved;
+        /** @brief length of the name. */
+        uint16_t nameLength;
+        /** @brief number of the songs played completely since the server started. */
+        uint64_t played;
+    };
+
+    /** @brief body of `EVENT`, followed by the name of the song. */
+    struct Event {
+        /** @brief id of the song. */
+        uint32_t songId;
+        /** @brief duration of the song in seconds. */
+        uint32_t duration;
+        /** @brief `EventKind`. */
+        uint8_t kind;
+        /** @brief unused, 0. */
+        uint8_t reserved;
+        /** @brief length of the name. */
+        uint16_t nameLength;
+    };
+
+    static_assert(sizeof(Header) == 8 && sizeof(EnqueueRequest) == 12 && sizeof(EnqueueReply) == 8
+                  && sizeof(StatusReply) == 24 && sizeof(Event) == 12, "messages must not have padding");
+
+    /**************************************************************************************************//**
+     * @brief encode writes a message into the buffer.
+     * @param buffer must have space for `sizeof(Header) + bodyLength + tailLength` bytes.
+     * @param type of the message.
+     * @param status of the reply.
+     * @param sequence of the request.
+     * @param body is the fixed part of the body (may be `NULL`).
+     * @param bodyLength is the length of the `body`.
+     * @param tail is the variable part of the body, i.e. a name (may be `NULL`).
+     * @param tailLength is the length of the `tail`.
+     * @return number of the bytes written.
+     *****************************************************************************************************/
+    inline size_t encode(char *buffer, const uint8_t type, const uint8_t status, const uint32_t sequence,
+                         const void *body, const size_t bodyLength, const void *tail = NULL, const size_t tailLength = 0)
+    {
+        Header header = {static_cast<uint16_t>(bodyLength + tailLength), type, status, sequence};
+        memcpy(buffer, &header, sizeof(header));
+        if(bodyLength > 0)
+            memcpy(buffer + sizeof(header), body, bodyLength);
+        if(tailLength > 0)
+            memcpy(buffer + sizeof(header) + bodyLength, tail, tailLength);
+        return sizeof(header) + bodyLength + tailLength;
+    }
+}
+
+#endif // CONTROLPROTOCOL_H
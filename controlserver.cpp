@@ -0,0 +1,565 @@
+#include "controlserver.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>        // for upper_bound()
+#include <unistd.h>         // for close()
+#include <fcntl.h>          // for open()
+#include <sys/socket.h>
+#include <sys/un.h>         // for sockaddr_un
+#include <sys/stat.h>       // for lstat()
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>   // for setrlimit()
+
+using namespace std;
+using namespace ControlProtocol;
+
+/* epoll data of the listening socket and the eventfd, connections use their index and generation. */
+static const uint64_t LISTEN_ID = 0xFFFFFFFFULL;
+static const uint64_t WAKE_ID = 0xFFFFFFFEULL;
+
+/* maximum number of the epoll events handled at once. */
+static const int MAX_EPOLL_EVENTS = 256;
+
+/* output buffer must have this space before a request is answered, so that its reply always fits. */
+static const size_t MAX_REPLY = sizeof(Header) + MAX_BODY;
+
+
+/* removes the socket file of a previous run, it refuses to remove a file which is not a socket, or a socket which is still served. */
+static void removeStaleSocket(const sockaddr_un &address)
+{
+    string path = address.sun_path;
+    struct stat status;
+    if(lstat(path.c_str(), &status) != 0){
+        if(errno == ENOENT)
+            return;
+        throw runtime_error("Failed to check '" + path + "': " + strerror(errno));
+    }
+    if(!S_ISSOCK(status.st_mode))
+        throw runtime_error("'" + path + "' exists and is not a socket");
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(probe < 0)
+        throw runtime_error(string("Failed to create the socket: ") + strerror(errno));
+    // a full backlog (EAGAIN) also means that a server is listening.
+    bool served = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0 || errno == EAGAIN;
+    close(probe);
+    if(served)
+        throw runtime_error("'" + path + "' is used by another server");
+
+    if(unlink(path.c_str()) != 0 && errno != ENOENT)
+        throw runtime_error("Failed to remove '" + path + "': " + strerror(errno));
+    LOG(info, "Removed the socket of a previous run '" + path + "'");
+}
+
+
+/* ========== CONSTRUCTOR - DESTRUCTOR ===========*/
+ControlServer::ControlServer(DisplayPlaylist *playlist, const string &socketPath, const size_t maxConnections)
+{
+    this->playlist = playlist;
+    this->socketPath = socketPath;
+    this->maxConnections = maxConnections;
+    listenFd = epollFd = wakeFd = reserveFd = -1;
+
+    connections.resize(maxConnections);
+    freeConnections.reserve(maxConnections);
+    for(size_t i=maxConnections; i>0; i--){ // lowest slots are used first
+        connections[i-1].fd = -1;
+        connections[i-1].generation = 0;
+        freeConnections.push_back(static_cast<uint32_t>(i-1));
+    }
+    subscribers.reserve(maxConnections);
+    events.reserve(1024);
+    eventBatch.reserve(1024);
+    eventEnds.reserve(1024);
+
+    nowPlaying = {0, 0, 0, 0, {}};
+    playing = false;
+    played = 0;
+
+    running = false;
+    openConnections = 0;
+    accepted = rejected = requests = sentEvents = droppedEvents = 0;
+    MUTEX_NAME(event_lock, "ControlServer::event_lock");
+}
+
+ControlServer::~ControlServer(){
+    stop();
+}
+
+void ControlServer::setLibraryRoot(const string &libraryRoot)
+{
+    filesystem::path root = filesystem::absolute(libraryRoot).lexically_normal();
+    if(!root.has_filename()) // i.e. "music/", so that the relative paths start with the first directory
+        root = root.parent_path();
+    this->libraryRoot = root;
+}
+
+
+/* ============= THREAD ==============*/
+void ControlServer::start()
+{
+    if(serverThread.joinable())
+        return;
+
+    // every connection needs a file descriptor, so the soft limit is raised up to the hard limit.
+    rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < maxConnections + 64){
+        limit.rlim_cur = min<rlim_t>(limit.rlim_max, maxConnections + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+        throw runtime_error("Invalid socket path '" + socketPath + "'");
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenFd < 0)
+        throw runtime_error(string("Failed to create the socket: ") + strerror(errno));
+    try {
+        removeStaleSocket(address);
+        if(bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+            throw runtime_error("Failed to bind '" + socketPath + "': " + strerror(errno));
+    } catch (const exception &) {
+        // socket file is not ours, so it must not be unlinked by stop().
+        close(listenFd);
+        listenFd = -1;
+        throw;
+    }
+    if(listen(listenFd, SOMAXCONN) != 0){
+        string error = strerror(errno);
+        stop();
+        throw runtime_error("Failed to listen on '" + socketPath + "': " + error);
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    epoll_event listenEvent = {EPOLLIN | EPOLLET, {.u64 = LISTEN_ID}};
+    epoll_event wakeEvent = {EPOLLIN | EPOLLET, {.u64 = WAKE_ID}};
+    if(epollFd < 0 || wakeFd < 0 || reserveFd < 0
+       || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) != 0
+       || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) != 0){
+        string error = strerror(errno);
+        stop();
+        throw runtime_error("Failed to create epoll: " + error);
+    }
+
+    running = true;
+    serverThread = thread(&ControlServer::run, this);
+    LOG(info, "Control server is listening on '" + socketPath + "'");
+}
+
+void ControlServer::stop()
+{
+    running = false;
+    if(serverThread.joinable()){
+        uint64_t one = 1;
+        if(write(wakeFd, &one, sizeof(one)) < 0)
+            LOG(warning, "Failed to wake the control server");
+        serverThread.join();
+        LOG(info, "Control server is stopped");
+    }
+
+    for(uint32_t i=0; i<connections.size(); i++)
+        if(connections[i].fd >= 0)
+            closeConnection(i);
+    if(listenFd >= 0)
+        unlink(socketPath.c_str());
+    for(int *fd : {&listenFd, &epollFd, &wakeFd, &reserveFd})
+        if(*fd >= 0){
+            close(*fd);
+            *fd = -1;
+        }
+}
+
+void ControlServer::run()
+{
+    epoll_event ready[MAX_EPOLL_EVENTS];
+    while(running)
+    {
+        int count = epoll_wait(epollFd, ready, MAX_EPOLL_EVENTS, -1);
+        if(count < 0){
+            if(errno == EINTR)
+                continue;
+            LOG(error, string("epoll_wait failed: ") + strerror(errno));
+            break;
+        }
+
+        for(int i=0; i<count; i++){
+            uint64_t id = ready[i].data.u64;
+            if(id == LISTEN_ID)
+                acceptConnections();
+            else if(id == WAKE_ID){
+                uint64_t value;
+                while(read(wakeFd, &value, sizeof(value)) > 0); // reset the eventfd
+                fanOutEvents();
+            }
+            else {
+                uint32_t index = static_cast<uint32_t>(id);
+                Connection &connection = connections[index];
+                if(connection.fd < 0 || connection.generation != static_cast<uint32_t>(id >> 32))
+                    continue; // connection was closed while handling the previous events
+                if(ready[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    connection.readable = true;
+                service(index);
+            }
+        }
+    }
+}
+
+
+/* ============= CONNECTIONS ==============*/
+void ControlServer::acceptConnections()
+{
+    while(true)
+    {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if((errno == EMFILE || errno == ENFILE) && reserveFd >= 0){
+                // edge-triggered listener is not reported again for the waiting connections, so they must not stay
+                // in the backlog: the reserved descriptor is freed to accept and close one, then it is taken again.
+                close(reserveFd);
+                fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+                if(fd >= 0){
+                    close(fd);
+                    rejected.fetch_add(1, memory_order_relaxed);
+                }
+                reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if(fd >= 0)
+                    continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG(warning, string("accept failed: ") + strerror(errno));
+            return;
+        }
+        if(freeConnections.empty()){
+            close(fd);
+            rejected.fetch_add(1, memory_order_relaxed);
+            continue;
+        }
+
+        uint32_t index = freeConnections.back();
+        freeConnections.pop_back();
+        Connection &connection = connections[index];
+        if(connection.input.empty()){ // first use of the slot
+            connection.input.resize(INPUT_BUFFER_SIZE);
+            connection.output.resize(OUTPUT_BUFFER_SIZE);
+        }
+        connection.fd = fd;
+        connection.generation++;
+        connection.readable = false;
+        connection.subscribed = false;
+        connection.inputUsed = connection.outputStart = connection.outputEnd = 0;
+        openConnections.fetch_add(1, memory_order_relaxed);
+        accepted.fetch_add(1, memory_order_relaxed);
+
+        // epoll reports the data which has already arrived, so nothing is missed by the edge-triggered mode.
+        epoll_event event = {EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                             {.u64 = index | (static_cast<uint64_t>(connection.generation) << 32)}};
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0){
+            LOG(warning, string("Failed to add the connection into epoll: ") + strerror(errno));
+            closeConnection(index);
+        }
+    }
+}
+
+void ControlServer::closeConnection(const uint32_t index)
+{
+    Connection &connection = connections[index];
+    if(connection.subscribed){
+        // swap with the last subscriber, so removing is O(1)
+        uint32_t last = subscribers.back();
+        subscribers[connection.subscriberIndex] = last;
+        connections[last].subscriberIndex = connection.subscriberIndex;
+        subscribers.pop_back();
+        connection.subscribed = false;
+    }
+    openConnections.fetch_sub(1, memory_order_relaxed);
+    close(connection.fd); // closing removes it from epoll
+    connection.fd = -1;
+    freeConnections.push_back(index);
+}
+
+bool ControlServer::service(const uint32_t index)
+{
+    Connection &connection = connections[index];
+    while(true)
+    {
+        bool progress = false;
+
+        if(connection.readable && connection.inputUsed < connection.input.size()){
+            ssize_t received = recv(connection.fd, connection.input.data() + connection.inputUsed,
+                                    connection.input.size() - connection.inputUsed, 0);
+            if(received > 0){
+                connection.inputUsed += received;
+                progress = true;
+            }
+            else if(received == 0){ // client closed the connection
+                closeConnection(index);
+                return false;
+            }
+            else if(errno == EAGAIN || errno == EWOULDBLOCK)
+                connection.readable = false;
+            else if(errno != EINTR){
+                closeConnection(index);
+                return false;
+            }
+        }
+
+        bool invalid = false;
+        if(handleRequests(index, invalid))
+            progress = true;
+        if(invalid){
+            closeConnection(index);
+            return false;
+        }
+
+        if(!flush(connection, progress)){
+            closeConnection(index);
+            return false;
+        }
+        if(!progress)
+            return true; // wait for the next epoll event
+    }
+}
+
+bool ControlServer::flush(Connection &connection, bool &progress)
+{
+    while(connection.outputStart < connection.outputEnd){
+        ssize_t sent = send(connection.fd, connection.output.data() + connection.outputStart,
+                            connection.outputEnd - connection.outputStart, MSG_NOSIGNAL);
+        if(sent > 0){
+            connection.outputStart += sent;
+            progress = true;
+        }
+        else if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true; // EPOLLOUT tells when it is writable again
+        else if(sent < 0 && errno == EINTR)
+            continue;
+        else
+            return false;
+    }
+    connection.outputStart = connection.outputEnd = 0;
+    return true;
+}
+
+size_t ControlServer::outputSpace(Connection &connection)
+{
+    if(connection.outputStart > 0){
+        size_t unsent = connection.outputEnd - connection.outputStart;
+        memmove(connection.output.data(), connection.output.data() + connection.outputStart, unsent);
+        connection.outputStart = 0;
+        connection.outputEnd = unsent;
+    }
+    return connection.output.size() - connection.outputEnd;
+}
+
+
+/* ============= REQUESTS ==============*/
+bool ControlServer::handleRequests(const uint32_t index, bool &invalid)
+{
+    Connection &connection = connections[index];
+    size_t offset = 0;
+    while(connection.inputUsed - offset >= sizeof(Header))
+    {
+        Header header;
+        memcpy(&header, connection.input.data() + offset, sizeof(header));
+        if(header.length > MAX_BODY){ // not a client of this protocol
+            invalid = true;
+            return false;
+        }
+        if(connection.inputUsed - offset < sizeof(Header) + header.length)
+            break; // request is not received completely
+        if(outputSpace(connection) < MAX_REPLY)
+            break; // answered once the client reads its replies
+
+        handleRequest(index, header, connection.input.data() + offset + sizeof(Header));
+        offset += sizeof(Header) + header.length;
+    }
+
+    if(offset > 0){
+        connection.inputUsed -= offset;
+        memmove(connection.input.data(), connection.input.data() + offset, connection.inputUsed);
+    }
+    return offset > 0;
+}
+
+bool ControlServer::resolveAudioPath(string_view audioPath, string &resolved) const
+{
+    if(libraryRoot.empty() || audioPath.find('\0') != string_view::npos)
+        return false;
+    // relative paths are inside the root, and an absolute path replaces the root, so both are checked alike.
+    filesystem::path path = (libraryRoot / filesystem::path(audioPath)).lexically_normal();
+    filesystem::path relative = path.lexically_relative(libraryRoot);
+    if(relative.empty() || relative == "." || *relative.begin() == "..")
+        return false;
+    resolved = path.string();
+    return true;
+}
+
+void ControlServer::handleRequest(const uint32_t index, const Header &header, const char *body)
+{
+    Connection &connection = connections[index];
+    char *output = connection.output.data() + connection.outputEnd;
+    requests.fetch_add(1, memory_order_relaxed);
+
+    switch(header.type)
+    {
+        case ENQUEUE: {
+            EnqueueRequest request;
+            if(header.length < sizeof(request)){
+                connection.outputEnd += encode(output, ERROR, BAD_REQUEST, header.sequence, NULL, 0);
+                return;
+            }
+            memcpy(&request, body, sizeof(request));
+            if(sizeof(request) + request.nameLength + request.thumbnailLength + request.audioLength != header.length){
+                connection.outputEnd += encode(output, ERROR, BAD_REQUEST, header.sequence, NULL, 0);
+                return;
+            }
+            const char *name = body + sizeof(request);
+            const char *thumbnail = name + request.nameLength;
+            const char *audio = thumbnail + request.thumbnailLength;
+            // audio file is read by the player, so the clients may only name the files of the library.
+            string audioPath;
+            if(request.audioLength > 0 && !resolveAudioPath(string_view(audio, request.audioLength), audioPath)){
+                connection.outputEnd += encode(output, ERROR, FORBIDDEN_PATH, header.sequence, NULL, 0);
+                return;
+            }
+            // strings of the clients are owned by the song, the pool of the interned strings is never freed.
+            Song song(string(name, request.nameLength), chrono::seconds(request.duration),
+                      string(thumbnail, request.thumbnailLength), audioPath, Song::OWNED);
+            EnqueueReply reply = {song.getId(), 0};
+            if(!playlist->enqueueSong(std::move(song))){
+                connection.outputEnd += encode(output, ERROR, PLAYLIST_FULL, header.sequence, NULL, 0);
+                return;
+            }
+            reply.pending = static_cast<uint32_t>(playlist->getPendingSongs());
+            connection.outputEnd += encode(output, ENQUEUED, OK, header.sequence, &reply, sizeof(reply));
+            break;
+        }
+        case STATUS: {
+            StatusReply reply = {nowPlaying.songId, nowPlaying.duration, static_cast<uint32_t>(playlist->getPendingSongs()),
+                                 static_cast<uint8_t>(playing), 0, nowPlaying.nameLength, played};
+            connection.outputEnd += encode(output, STATUS_REPLY, OK, header.sequence, &reply, sizeof(reply),
+                                           nowPlaying.name, nowPlaying.nameLength);
+            break;
+        }
+        case SUBSCRIBE:
+            if(!connection.subscribed){
+                connection.subscribed = true;
+                connection.subscriberIndex = subscribers.size();
+                subscribers.push_back(index);
+            }
+            connection.outputEnd += encode(output, SUBSCRIBED, OK, header.sequence, NULL, 0);
+            break;
+        case UNSUBSCRIBE:
+            if(connection.subscribed){
+                uint32_t last = subscribers.back();
+                subscribers[connection.subscriberIndex] = last;
+                connections[last].subscriberIndex = connection.subscriberIndex;
+                subscribers.pop_back();
+                connection.subscribed = false;
+            }
+            connection.outputEnd += encode(output, UNSUBSCRIBED, OK, header.sequence, NULL, 0);
+            break;
+        default:
+            connection.outputEnd += encode(output, ERROR, UNKNOWN_TYPE, header.sequence, NULL, 0);
+    }
+}
+
+
+/* ============= EVENTS ==============*/
+void ControlServer::songStarted(const Song &song){
+    postEvent(SONG_STARTED, song);
+}
+
+void ControlServer::songFinished(const Song &song){
+    postEvent(SONG_FINISHED, song);
+}
+
+void ControlServer::postEvent(const uint8_t kind, const Song &song)
+{
+    bool wasEmpty;
+    {
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(event_lock));
+        wasEmpty = events.empty();
+        events.push_back({kind, song.getId(), static_cast<unsigned int>(song.getDuration().count()), 0, {}});
+        PlayEvent &event = events.back();
+        event.nameLength = static_cast<uint16_t>(min<size_t>(song.getName().size(), MAX_NAME));
+        memcpy(event.name, song.getName().data(), event.nameLength);
+    }
+    // server thread is woken once per batch, the events queued until it wakes are sent together.
+    if(wasEmpty && wakeFd >= 0){
+        uint64_t one = 1;
+        if(write(wakeFd, &one, sizeof(one)) < 0)
+            LOG(warning, "Failed to wake the control server");
+    }
+}
+
+void ControlServer::fanOutEvents()
+{
+    {
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(event_lock));
+        eventBatch.swap(events);
+    }
+    if(eventBatch.empty())
+        return;
+
+    // encode the batch once, and update the now playing status.
+    eventBlock.resize(eventBatch.size() * (sizeof(Header) + sizeof(Event) + MAX_NAME));
+    eventEnds.clear();
+    size_t length = 0;
+    for(const PlayEvent &playEvent : eventBatch){
+        Event event = {playEvent.songId, playEvent.duration, playEvent.kind, 0, playEvent.nameLength};
+        length += encode(eventBlock.data() + length, EVENT, OK, 0, &event, sizeof(event), playEvent.name, playEvent.nameLength);
+        eventEnds.push_back(length);
+
+        nowPlaying = playEvent;
+        playing = playEvent.kind == SONG_STARTED;
+        if(playEvent.kind == SONG_FINISHED)
+            played++;
+    }
+
+    // copy the batch to every subscriber, as many whole events as its output buffer can take (a batch may be larger
+    // than the buffer), backwards since a failed subscriber is removed by swapping with the last.
+    for(size_t i=subscribers.size(); i>0; i--){
+        uint32_t index = subscribers[i-1];
+        Connection &connection = connections[index];
+        size_t copied = 0;
+        bool open = true;
+        while(copied < eventEnds.size() && open){
+            size_t start = copied == 0 ? 0 : eventEnds[copied-1];
+            size_t end = upper_bound(eventEnds.begin() + copied, eventEnds.end(), start + outputSpace(connection)) - eventEnds.begin();
+            if(end == copied)
+                break; // output buffer is full, the remaining events are dropped
+            memcpy(connection.output.data() + connection.outputEnd, eventBlock.data() + start, eventEnds[end-1] - start);
+            connection.outputEnd += eventEnds[end-1] - start;
+            copied = end;
+
+            bool progress = false;
+            open = flush(connection, progress);
+        }
+        sentEvents.fetch_add(copied, memory_order_relaxed);
+        droppedEvents.fetch_add(eventEnds.size() - copied, memory_order_relaxed);
+        if(!open)
+            closeConnection(index);
+    }
+    eventBatch.clear();
+}
+
+
+/* ============= PUBLISHED STATE ==============*/
+ControlServer::Statistics ControlServer::getStatistics() const
+{
+    return {openConnections.load(memory_order_relaxed), accepted.load(memory_order_relaxed),
+            rejected.load(memory_order_relaxed), requests.load(memory_order_relaxed),
+            sentEvents.load(memory_order_relaxed), droppedEvents.load(memory_order_relaxed)};
+}
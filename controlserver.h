@@ -0,0 +1,274 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <string>
+#include <filesystem>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include "displayplaylist.h"
+#include "controlprotocol.h"
+#include "profiledmutex.h"
+
+
+/*****************************************************************************************************************//**
+ * @class ControlServer
+ * @brief ControlServer lets the local clients drive a [DisplayPlaylist](@ref DisplayPlaylist) through a Unix domain socket.
+ *
+ * Clients can enqueue songs, query the now playing status and subscribe to the play events,
+ * with the binary protocol of [ControlProtocol](@ref ControlProtocol).\n
+ * A single thread serves all the connections with edge-triggered `epoll`:
+ * 1. every connection has an input and an output buffer, allocated once per connection slot and reused,
+ *    so serving a request never allocates (except the strings of an enqueued song, which are owned by the song,
+ *    and at most `DisplayPlaylist::MAX_PENDING_SONGS` songs wait in the playlist).
+ * 2. a connection is read until `EAGAIN`, all the complete requests are answered into its output buffer,
+ *    and the replies are written with a single `send()`.
+ * 3. play events arrive from the player thread through a short locked queue and an `eventfd`.
+ *    Events queued meanwhile are encoded once, and the batch is copied to every subscriber,
+ *    as many whole events as its output buffer can take.
+ * .
+ * Songs are enqueued with DisplayPlaylist::enqueueSong(), and the status is kept by the server thread from the
+ * play events, so the server never waits for `_lock_` of the playlist, which is held for the whole song.\n
+ * If a subscriber does not read its events and its output buffer is full, the events which do not fit are dropped for it
+ * (see `Statistics::droppedEvents`), instead of blocking the other clients.
+ ********************************************************************************************************************/
+class ControlServer : public PlaylistListener
+{
+public:
+
+    /** @brief Statistics of the server. */
+    struct Statistics {
+        /** @brief number of the open connections. */
+        size_t connections;
+        /** @brief number of the connections accepted since start. */
+        unsigned long long accepted;
+        /** @brief number of the connections refused, since `maxConnections` were open. */
+        unsigned long long rejected;
+        /** @brief number of the requests served. */
+        unsigned long long requests;
+        /** @brief number of the events sent to the subscribers. */
+        unsigned long long events;
+        /** @brief number of the events dropped for the subscribers with a full output buffer. */
+        unsigned long long droppedEvents;
+    };
+
+    /** @brief size of the input buffer of a connection. */
+    static const size_t INPUT_BUFFER_SIZE = 4 * 1024;
+
+    /** @brief size of the output buffer of a connection. */
+    static const size_t OUTPUT_BUFFER_SIZE = 16 * 1024;
+
+    /*************************************************************************************************//**
+     * @brief ControlServer constructor, the socket is created by `start()`.
+     * @param playlist is the playlist to drive, its keep alive mode should be enabled.
+     * @param socketPath is the path of the Unix domain socket.
+     * @param maxConnections is the maximum number of the open connections (default 4096).
+     ****************************************************************************************************/
+    ControlServer(DisplayPlaylist *playlist, const std::string &socketPath, const size_t maxConnections = 4096);
+
+    /** @brief ~ControlServer stops the server. */
+    ~ControlServer();
+
+    ControlServer(const ControlServer &) = delete;
+    ControlServer& operator= (const ControlServer &) = delete;
+
+    /*************************************************************************************************//**
+     * @brief start creates the socket and the server thread, it throws `std::runtime_error` on failure.
+     *
+     * Socket file of a previous run is removed, but start fails if the path is not a socket,
+     * or if another server still accepts connections on it.
+     ****************************************************************************************************/
+    void start();
+
+    /*************************************************************************************************//**
+     * @brief setLibraryRoot sets the directory of the audio files of the enqueued songs, before `start()`.
+     *
+     * Audio path of a song is resolved against the root, and the song is refused with `FORBIDDEN_PATH`
+     * if the path leaves the root (checked lexically, the symbolic links of the library are trusted).\n
+     * By default there is no library, so only the songs without an audio path are accepted.
+     * @param libraryRoot is the music directory.
+     ****************************************************************************************************/
+    void setLibraryRoot(const std::string &libraryRoot);
+
+    /** @brief stop closes all the connections, removes the socket and joins the server thread. */
+    void stop();
+
+    /** @brief returns the statistics of the server. */
+    Statistics getStatistics() const;
+
+    /** @brief queues the event for the subscribers (called from the player thread). */
+    void songStarted(const Song &song) override;
+
+    /** @brief queues the event for the subscribers (called from the player thread). */
+    void songFinished(const Song &song) override;
+
+private:
+
+    /** @brief Connection is a client connection, connections are stored in slots which are reused. */
+    struct Connection {
+        /** @brief socket of the connection, -1 if the slot is free. */
+        int fd;
+        /** @brief generation of the slot, to ignore the epoll events of a closed connection. */
+        uint32_t generation;
+        /** @brief readable is true until a read returns `EAGAIN` (edge-triggered). */
+        bool readable;
+        /** @brief subscribed tells whether the client receives the events. */
+        bool subscribed;
+        /** @brief index of the connection in `subscribers`. */
+        size_t subscriberIndex;
+        /** @brief received bytes, which are not a complete request yet. */
+        std::vector<char> input;
+        /** @brief number of the bytes in `input`. */
+        size_t inputUsed;
+        /** @brief replies and events to send. */
+        std::vector<char> output;
+        /** @brief first byte of `output` which is not sent yet. */
+        size_t outputStart;
+        /** @brief end of the bytes in `output`. */
+        size_t outputEnd;
+    };
+
+    /** @brief PlayEvent is an event queued by the player thread. */
+    struct PlayEvent {
+        /** @brief `ControlProtocol::EventKind`. */
+        uint8_t kind;
+        /** @brief id of the song. */
+        unsigned int songId;
+        /** @brief duration of the song in seconds. */
+        unsigned int duration;
+        /** @brief length of the `name`. */
+        uint16_t nameLength;
+        /** @brief name of the song, truncated to `MAX_NAME` (copied, since the song may be freed before the event is sent). */
+        char name[ControlProtocol::MAX_NAME];
+    };
+
+    /** @brief run is the body of the server thread. */
+    void run();
+
+    /** @brief accepts all the pending connections. */
+    void acceptConnections();
+
+    /** @brief closes the connection and frees its slot. */
+    void closeConnection(const uint32_t index);
+
+    /** @brief reads, answers and writes the connection until it would block, returns false if it is closed. */
+    bool service(const uint32_t index);
+
+    /***************************************************************************************************//**
+     * @brief answers the complete requests of the connection, while its output buffer has space.
+     * @param index of the connection.
+     * @param invalid is set to true if the input is not a message of the protocol.
+     * @return true if any request is answered.
+     ******************************************************************************************************/
+    bool handleRequests(const uint32_t index, bool &invalid);
+
+    /** @brief resolves the audio path of an enqueued song into `resolved`, returns false if it is not inside `libraryRoot`. */
+    bool resolveAudioPath(std::string_view audioPath, std::string &resolved) const;
+
+    /** @brief answers one request of the connection into its output buffer. */
+    void handleRequest(const uint32_t index, const ControlProtocol::Header &header, const char *body);
+
+    /** @brief writes the output buffer until it would block, returns false on error. */
+    bool flush(Connection &connection, bool &progress);
+
+    /** @brief free space at the end of the output buffer, after moving the unsent bytes to its beginning. */
+    size_t outputSpace(Connection &connection);
+
+    /** @brief queues the event and wakes the server thread. */
+    void postEvent(const uint8_t kind, const Song &song);
+
+    /** @brief sends the queued events to the subscribers. */
+    void fanOutEvents();
+
+    /** @brief playlist which is driven by the clients. */
+    DisplayPlaylist *playlist;
+
+    /** @brief path of the socket. */
+    std::string socketPath;
+
+    /** @brief maximum number of the open connections. */
+    size_t maxConnections;
+
+    /** @brief absolute and normalized directory of the audio files, empty if audio paths are not accepted. */
+    std::filesystem::path libraryRoot;
+
+    /** @brief listening socket. */
+    int listenFd;
+
+    /** @brief epoll instance. */
+    int epollFd;
+
+    /** @brief wakeFd is an `eventfd` which wakes the server thread for the events and stop. */
+    int wakeFd;
+
+    /** @brief reserveFd is kept open, and freed to accept and refuse a connection when the descriptors run out. */
+    int reserveFd;
+
+    /** @brief connection slots, the buffers of a slot are allocated on its first use. */
+    std::vector<Connection> connections;
+
+    /** @brief indexes of the free connection slots. */
+    std::vector<uint32_t> freeConnections;
+
+    /** @brief indexes of the subscribed connections. */
+    std::vector<uint32_t> subscribers;
+
+    /** @brief events queued by the player thread. */
+    std::vector<PlayEvent> events;
+
+    /** @brief event_lock protects `events`. */
+    PlayerMutex event_lock;
+
+    /** @brief events taken from `events` by the server thread, swapped to keep the capacity of both. */
+    std::vector<PlayEvent> eventBatch;
+
+    /** @brief encoded messages of the `eventBatch`, copied to every subscriber. */
+    std::vector<char> eventBlock;
+
+    /** @brief eventEnds[i] is the end of the message of the event i in `eventBlock`. */
+    std::vector<size_t> eventEnds;
+
+    /*
+     * Below members are used only by the server thread.
+     */
+
+    /** @brief last song started. */
+    PlayEvent nowPlaying;
+
+    /** @brief playing is true if the `nowPlaying` song is not finished yet. */
+    bool playing;
+
+    /** @brief number of the songs played completely. */
+    unsigned long long played;
+
+    /** @brief serverThread runs `run()`. */
+    std::thread serverThread;
+
+    /** @brief running is true until the server is asked to stop. */
+    std::atomic<bool> running;
+
+    /*
+     * Below counters are written by the server thread and read by getStatistics().
+     */
+
+    /** @brief number of the open connections. */
+    std::atomic<size_t> openConnections;
+
+    /** @brief number of the connections accepted. */
+    std::atomic<unsigned long long> accepted;
+
+    /** @brief number of the connections refused. */
+    std::atomic<unsigned long long> rejected;
+
+    /** @brief number of the requests served. */
+    std::atomic<unsigned long long> requests;
+
+    /** @brief number of the events sent. */
+    std::atomic<unsigned long long> sentEvents;
+
+    /** @brief number of the events dropped. */
+    std::atomic<unsigned long long> droppedEvents;
+};
+
+#endif // CONTROLSERVER_H
@@ -1,14 +1,28 @@
 #include "displayplaylist.h"
 #include <iomanip>
+#include <cmath>
 #include "logger.h"
+#include "seektable.h"
+#include "loudness.h"
 
 using namespace std;
 using namespace SongError;
 
-DisplayPlaylist::DisplayPlaylist()
+DisplayPlaylist::DisplayPlaylist(PlayerClock *clock)
 {
+    this->clock = clock;
+    this->renderer = NULL;
+    this->listener = NULL;
+    this->screenOutput = true;
     this->songPlaying = true;
     this->executionComplete = false;
+    this->keepAlive = false;
+    this->inboxPending = false;
+    this->pendingSongs = 0;
+    this->preparingSongs = 0;
+    this->preparerStopped = false;
+    MUTEX_NAME(_lock_, "DisplayPlaylist::_lock_");
+    MUTEX_NAME(inbox_lock, "DisplayPlaylist::inbox_lock");
     LOG(trace, "MusicPlayer object created");
 }
 
@@ -17,57 +31,245 @@ DisplayPlaylist::~DisplayPlaylist(){
     // to save error thread from infinate waiting.
     LOG(trace, "Execution Begin");
     this->errorRaised.notify_all();
+    {
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(inbox_lock));
+        preparerStopped = true;
+    }
+    preparerCondition.notify_all();
+    if(preparer.joinable())
+        preparer.join();
     LOG(trace, "Execution End");
 }
 
 void DisplayPlaylist::pushSongIntoPlaylist(const Song &song){
     try {
         playlist.push(song);
-        LOG(trace, "Pushing song into playlist. Song id: "+to_string(song.getId())+", name: "+song.getName());
+        pendingSongs++;
+        prepareSong(playlist.back());
+        LOGF(trace, "Pushing song into playlist. Song id: %u, name: %.*s", song.getId(), (int)song.getName().size(), song.getName().data());
+    } catch (const exception &e) {
+        LOG(error, e.what());
+    }
+}
+
+void DisplayPlaylist::pushSongIntoPlaylist(Song &&song){
+    try {
+        playlist.push(std::move(song));
+        pendingSongs++;
+        Song &pushed = playlist.back();
+        prepareSong(pushed);
+        LOGF(trace, "Moving song into playlist. Song id: %u, name: %.*s", pushed.getId(), (int)pushed.getName().size(), pushed.getName().data());
+    } catch (const exception &e) {
+        LOG(error, e.what());
+    }
+}
+
+void DisplayPlaylist::emplaceSongIntoPlaylist(const string &name, const chrono::seconds &duration, const string &thumbnailPath, const string &audioPath){
+    try {
+        playlist.emplace(name, duration, thumbnailPath, audioPath);
+        pendingSongs++;
+        Song &emplaced = playlist.back();
+        prepareSong(emplaced);
+        LOGF(trace, "Emplacing song into playlist. Song id: %u, name: %.*s", emplaced.getId(), (int)emplaced.getName().size(), emplaced.getName().data());
+    } catch (const exception &e) {
+        LOG(error, e.what());
+    }
+}
+
+void DisplayPlaylist::reservePlaylist(const size_t totalSongs){
+    playlist.reserve(totalSongs);
+}
+
+void DisplayPlaylist::enableScreenOutput(){
+    screenOutput = true;
+}
+
+void DisplayPlaylist::disableScreenOutput(){
+    screenOutput = false;
+}
+
+void DisplayPlaylist::setRenderer(AudioRenderer *renderer){
+    this->renderer = renderer;
+}
+
+void DisplayPlaylist::setListener(PlaylistListener *listener){
+    this->listener = listener;
+}
+
+void DisplayPlaylist::setKeepAlive(const bool keepAlive){
+    if(!keepAlive){
+        // songs being prepared are not in the inbox yet, so the player would finish without them.
+        unique_lock<PlayerMutex> lock(MUTEX_SITE(inbox_lock));
+        inboxCondition.wait(lock, [this](){ return preparingSongs == 0 || preparerStopped; });
+    }
+    this->keepAlive = keepAlive;
+    songCondition.notify_all();
+    wakeIdlePlayer();
+}
+
+size_t DisplayPlaylist::getPendingSongs() const {
+    return pendingSongs.load();
+}
+
+bool DisplayPlaylist::enqueueSong(Song &&song){
+    try {
+        LOGF(trace, "Enqueueing song into playlist. Song id: %u, name: %.*s", song.getId(), (int)song.getName().size(), song.getName().data());
+        {
+            // bound is checked and counted under the same lock, so concurrent callers can not exceed it.
+            lock_guard<PlayerMutex> lock(MUTEX_SITE(inbox_lock));
+            if(pendingSongs >= MAX_PENDING_SONGS){
+                LOGF(debug, "Playlist is full, song id: %u is not enqueued", song.getId());
+                return false;
+            }
+            if(!preparer.joinable())
+                preparer = thread(&DisplayPlaylist::prepareSongs, this);
+            unprepared.push_back(std::move(song));
+            preparingSongs++;
+            pendingSongs++;
+        }
+        preparerCondition.notify_one(); // song is prepared by the preparer, so the caller never touches the audio files
+        return true;
     } catch (const exception &e) {
         LOG(error, e.what());
+        return false;
     }
 }
 
+void DisplayPlaylist::prepareSong(Song &song)
+{
+    SeekTableCache::get()->prepare(song);
+    Loudness loudness;
+    if(LoudnessCache::get()->find(song, loudness))
+        song.setGainDb(loudness.gainDb());
+}
+
+void DisplayPlaylist::prepareSongs()
+{
+    LOG(trace, "Execution Begin");
+    vector<Song> songs;
+    unique_lock<PlayerMutex> lock(MUTEX_SITE(inbox_lock));
+    while(true)
+    {
+        preparerCondition.wait(lock, [this](){ return !unprepared.empty() || preparerStopped; });
+        if(preparerStopped) break;
+        songs.swap(unprepared);
+
+        // files are scanned without the lock, so enqueueSong() and the player never wait for them.
+        lock.unlock();
+        for(Song &song : songs){
+            try {
+                prepareSong(song);
+            } catch (const exception &e) {
+                LOG(error, e.what()); // song is still played, with unity gain
+            }
+        }
+        lock.lock();
+
+        for(Song &song : songs)
+            inbox.push_back(std::move(song));
+        preparingSongs -= songs.size();
+        songs.clear();
+        inboxPending = true;
+        inboxCondition.notify_all(); // wake the player, if it is waiting for the songs
+    }
+    LOG(trace, "Execution End");
+}
+
+void DisplayPlaylist::wakeIdlePlayer()
+{
+    // player checks the flags under inbox_lock before waiting, so once the lock is taken, the player is either waiting or sees the flags.
+    { lock_guard<PlayerMutex> lock(MUTEX_SITE(inbox_lock)); }
+    inboxCondition.notify_all();
+}
+
+void DisplayPlaylist::completeExecution()
+{
+    executionComplete = true;
+    errorRaised.notify_all(); // wake the error thread, so that it doesn't wait for its next timeout.
+    wakeIdlePlayer(); // idle player holds _lock_ while waiting for the inbox, so it is woken before _lock_ is taken.
+    // threads check the flag under _lock_ before waiting, so once the lock is taken, they are either waiting or see the flag.
+    { lock_guard<PlayerMutex> lock(MUTEX_SITE(_lock_)); }
+    songCondition.notify_all();
+}
+
+void DisplayPlaylist::takeInbox()
+{
+    if(!inboxPending)
+        return;
+    lock_guard<PlayerMutex> lock(MUTEX_SITE(inbox_lock));
+    for(Song &song : inbox)
+        playlist.push(std::move(song));
+    inbox.clear();
+    inboxPending = false;
+}
+
+PlaylistListener::~PlaylistListener(){}
+
 void DisplayPlaylist::playPlaylist()
 {
     LOG(trace, "Execution Begin");
     try {
-        if(playlist.empty()){
+        if(playlist.empty() && !keepAlive){
             LOG(trace,"NO SONGS IN PLAYLIST");
             executionComplete = true;
             return;
         }
-        while(playlist.size()>1 || songPlaying)
+        while(playlist.size()>1 || songPlaying || keepAlive)
         {
             LOG(debug, "displaySongDetails() inside while loop");
 
-            unique_lock<mutex> uniqueLock(_lock_);
-            while (!songPlaying){ // wait until the song starts playing
+            unique_lock<PlayerMutex> uniqueLock(MUTEX_SITE(_lock_));
+            if(!songPlaying){ // wait until the song starts playing
                 LOG(debug, "displaySongDetails() is waiting");
-                songCondition.wait(uniqueLock);
-                if(executionComplete) return; // if any exception occures during execution, this flag will be true, means stop the execution.
+                songCondition.wait(uniqueLock, [this](){ return songPlaying || executionComplete; });
+                if(!songPlaying) return; // execution is completed (or an exception occured) while waiting for the song.
+            }
+            if(playlist.empty()){ // last song is already popped
+                takeInbox();
+                if(playlist.empty() && keepAlive){
+                    /* enqueueSong() pushes and notifies under inbox_lock, so waiting on it never misses a song. */
+                    unique_lock<PlayerMutex> inboxLock(MUTEX_SITE(inbox_lock));
+                    inboxCondition.wait(inboxLock, [this](){ return inboxPending || !keepAlive || executionComplete; });
+                    inboxLock.unlock();
+                    if(executionComplete) break;
+                    takeInbox();
+                }
+                if(playlist.empty()) break;
             }
 
             LOG(debug, "displaySongDetails() going to play a Song");
             /* Custom exception throwing test. Uncomment below line to throw exception. */
             //throw ErrorCode::NO_INTERNET_CONNECTION;
 
-            system("clear"); // comment this if you want to display logs
+            const Song &song = playlist.front();
+            chrono::seconds songLength = song.getDuration();
+
+            /* loudness is normalized with the gain resolved when the song was queued, see prepareSong(). */
+            if(renderer != NULL)
+                renderer->setVolume(static_cast<float>(pow(10.0, song.getGainDb() / 20.0)));
 
-            chrono::seconds songLength = playlist.front().getDuration();
+            if(screenOutput){
+                system("clear"); // comment this if you want to display logs
 
-            printf("\n\n  ===== LALIFY MUSIC PLAYER =====\n");
-            printf("\n\tSong   : %s\n", playlist.front().getName().c_str());
-            cout << "\n\tLength : " << setfill('0') << setw(2) << (songLength.count()/60)
-                 << ":" << setw(2) << (songLength.count()%60) << endl;
+                printf("\n\n  ===== LALIFY MUSIC PLAYER =====\n");
+                printf("\n\tSong   : %.*s\n", (int)song.getName().size(), song.getName().data());
+                cout << "\n\tLength : " << setfill('0') << setw(2) << (songLength.count()/60)
+                     << ":" << setw(2) << (songLength.count()%60) << endl;
+                printf("\n\tGain   : %+.1f dB\n", song.getGainDb());
+            }
 
-            LOG(debug, "Song Playing id: "+to_string(playlist.front().getId())+", name: "+playlist.front().getName());
+            LOGF(debug, "Song Playing id: %u, name: %.*s", song.getId(), (int)song.getName().size(), song.getName().data());
+            pendingSongs--;
+            if(listener != NULL)
+                listener->songStarted(song);
 
             /* wait/sleep until the duration of the song is completed */
-            this_thread::sleep_for(songLength);
+            clock->sleepFor(songLength);
 
-            LOG(debug, "Song Completed id: "+to_string(playlist.front().getId())+", name: "+playlist.front().getName());
+            LOGF(debug, "Song Completed id: %u, name: %.*s", song.getId(), (int)song.getName().size(), song.getName().data());
+            if(listener != NULL)
+                listener->songFinished(song);
+            takeInbox(); // songs enqueued during the song, so that the loop sees them
 
             /* unlock after the song is played and notify the pop thread. */
             uniqueLock.unlock();
@@ -84,7 +286,7 @@ void DisplayPlaylist::playPlaylist()
         errorMessage = string(error.what()) + " , in -> %s"+__PRETTY_FUNCTION__;
         errorRaised.notify_all();
     }
-    executionComplete = true;
+    completeExecution();
     LOG(trace, "Execution End");
 }
 
@@ -92,18 +294,20 @@ void DisplayPlaylist::playNextSong()
 {
     LOG(trace, "Execution Begin");
     try {
-        while(!playlist.empty())
+        while(!playlist.empty() || keepAlive)
         {
             LOG(debug, "playNextSong() inside while loop");
 
-            unique_lock<mutex> uniqueLock(_lock_);
-            while (songPlaying) // wait until the song stops playing
-            {
+            unique_lock<PlayerMutex> uniqueLock(MUTEX_SITE(_lock_));
+            if(songPlaying){ // wait until the song stops playing
                 LOG(debug, "playNextSong() is waiting");
-                songCondition.wait(uniqueLock);
+                songCondition.wait(uniqueLock, [this](){ return !songPlaying || executionComplete; });
                 if(executionComplete) return; // if any exception occures during execution, this flag will be true, means stop the execution.
             }
-            LOG(debug, "playNextSong() is poping song id: "+to_string(playlist.front().getId())+", name: "+playlist.front().getName());
+            takeInbox();
+            if(playlist.empty()) break; // playlist is finished while waiting
+            const Song &song = playlist.front();
+            LOGF(debug, "playNextSong() is poping song id: %u, name: %.*s", song.getId(), (int)song.getName().size(), song.getName().data());
 
             playlist.pop();
             songPlaying = true;
@@ -122,7 +326,7 @@ void DisplayPlaylist::playNextSong()
         errorRaised.notify_all();
         LOG(error, e.what());
     }
-    executionComplete = true;
+    completeExecution();
     LOG(trace, "Execution End");
 }
 
@@ -132,8 +336,9 @@ void DisplayPlaylist::monitorException(int &returnValue)
     try {
         /* tempErrorLock is used instead of global _lock_ with unique_lock,
          * to maintain the proper sequence of the program. */
-        mutex tempErrorLock;
-        unique_lock<mutex> uniqueLock(tempErrorLock);
+        PlayerMutex tempErrorLock;
+        MUTEX_NAME(tempErrorLock, "DisplayPlaylist::monitorException::tempErrorLock");
+        unique_lock<PlayerMutex> uniqueLock(MUTEX_SITE(tempErrorLock));
 
         /* wait until either execution completed or exception occured. */
         while(!executionComplete && errorMessage.empty()){
@@ -147,9 +352,8 @@ void DisplayPlaylist::monitorException(int &returnValue)
         if(!errorMessage.empty())
         {
             cout << "\n ERROR: " << errorMessage << endl;
-            executionComplete = true;
             returnValue = 1;
-            songCondition.notify_all(); // to wake all the sleeping threads so that they can end their execution.
+            completeExecution(); // to wake all the sleeping threads so that they can end their execution.
         }
     } catch (const exception &e) {
         LOG(error, e.what());
@@ -2,12 +2,39 @@
 #define DISPLAYDATA_H
 
 #include <iostream>
-#include <queue>
+#include <vector>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 #include "song.h"
 #include "logger.h"
+#include "profiledmutex.h"
+#include "playerclock.h"
+#include "audiorenderer.h"
+#include "ringqueue.h"
+
+/*****************************************************************************************************//**
+ * @class PlaylistListener
+ * @brief PlaylistListener is notified when a song of the [DisplayPlaylist](@ref DisplayPlaylist) starts and finishes.
+ *
+ * Its methods are called from the thread of `playPlaylist()` while it holds `_lock_`,
+ * so they must return quickly and must not call the playlist.
+ ********************************************************************************************************/
+class PlaylistListener
+{
+public:
+
+    /** @brief ~PlaylistListener virtual destructor. */
+    virtual ~PlaylistListener();
+
+    /** @brief songStarted is called when the song starts playing. */
+    virtual void songStarted(const Song &song) = 0;
+
+    /** @brief songFinished is called when the song is played completely. */
+    virtual void songFinished(const Song &song) = 0;
+};
+
 
 /**
  * @class DisplayPlaylist
@@ -22,14 +49,34 @@
  * playNextSong() pops the first song from the playlis(queue) after it is played successfully.\n\n
  *
  * checkForException() waits until any exception is raised or occured,
- * and prints the exception and returns value 1.
+ * and prints the exception and returns value 1.\n\n
+ *
+ * While the playlist is playing, songs can be added only by enqueueSong(), from any thread.\n
+ * Enqueued songs wait in an inbox with its own lock, and are moved into the playlist by the player threads,
+ * so enqueueing never waits for `_lock_`, which is held for the whole song.\n
+ * Enqueued songs are prepared (see prepareSong()) by a preparer thread, in the order they are enqueued,
+ * so enqueueing never touches the audio files either.
  */
 class DisplayPlaylist
 {
 public:
 
-    /** @brief DisplayPlaylist is a default constructor. */
-    DisplayPlaylist();
+    /*****************************************************************************************************//**
+     * @brief maximum number of the songs waiting to be played, beyond which enqueueSong() refuses the songs.
+     *
+     * It bounds the memory of the enqueued songs, whose strings must be `Song::OWNED`.\n
+     * Interned strings are never freed, so the pool grows with every distinct name and path interned,
+     * and it is bounded only by the library pushed by the program itself, never by the songs of the clients.
+     ********************************************************************************************************/
+    static const size_t MAX_PENDING_SONGS = 10000;
+
+    /*************************************************************************************//**
+     * @brief DisplayPlaylist is a constructor.
+     * @param clock is used to wait for the duration of the songs (default real time clock).
+     *
+     * Pass a [VirtualClock](@ref VirtualClock) to fast-forward the whole playlist.
+     ****************************************************************************************/
+    DisplayPlaylist(PlayerClock *clock = PlayerClock::realTime());
 
     /** @brief ~DisplayPlaylist is a destructor. */
     ~DisplayPlaylist();
@@ -73,13 +120,94 @@ public:
      ***********************************************************************************/
     void pushSongIntoPlaylist(const Song &song);
 
+    /**********************************************************************************//**
+     * @brief It moves the Song class object into the playlist (queue), without copying it.
+     * @param song is the objecet of the Song, that needs to be moved into the playlist.
+     ***********************************************************************************/
+    void pushSongIntoPlaylist(Song &&song);
+
+    /*****************************************************************************************//**
+     * @brief It constructs the Song directly inside the playlist (queue).
+     * @param name of the song.
+     * @param duration of the song in seconds.
+     * @param thumbnailPath is the path of song thumbnail.
+     * @param audioPath is the path of the audio file of the song (default empty).
+     ********************************************************************************************/
+    void emplaceSongIntoPlaylist(const std::string &name,
+                                 const std::chrono::seconds &duration,
+                                 const std::string &thumbnailPath,
+                                 const std::string &audioPath = "");
+
+    /*****************************************************************************************//**
+     * @brief It makes space for the songs in the playlist, so that pushing them does not allocate.
+     * @param totalSongs is the number of the songs which will be in the playlist at once.
+     *
+     * Without it, the playlist grows by doubling, and keeps its space when the songs are popped.
+     ********************************************************************************************/
+    void reservePlaylist(const size_t totalSongs);
+
+    /** @brief enables displaying the song details on the screen (default). */
+    void enableScreenOutput();
+
+    /** @brief disables displaying the song details on the screen, i.e. while simulating the playlist. */
+    void disableScreenOutput();
+
+    /*******************************************************************************************************//**
+     * @brief setRenderer sets the renderer, whose volume is set to the loudness gain of every song played.
+     *
+     * Gain is taken from the [LoudnessCache](@ref LoudnessCache) when the song is queued (see `Song::getGainDb()`),
+     * songs which are not analysed are played at unity gain.\n
+     * playPlaylist() becomes the control thread of the renderer, so no other thread may send it commands.
+     * @param renderer is the audio renderer (default `NULL`, no renderer).
+     **********************************************************************************************************/
+    void setRenderer(AudioRenderer *renderer);
+
+    /*****************************************************************************************************//**
+     * @brief enqueueSong adds the song at the end of the playlist, while the playlist is playing (thread safe).
+     *
+     * It locks only the inbox, so it never waits for the song being played,
+     * and the song is prepared by the preparer thread (started by the first call), not by the caller.
+     * @param song is moved into the inbox.
+     * @return false if `MAX_PENDING_SONGS` songs are already waiting, then the song is not enqueued.
+     ********************************************************************************************************/
+    bool enqueueSong(Song &&song);
+
+    /*************************************************************************************************//**
+     * @brief setKeepAlive determines whether the playlist waits for enqueued songs after the last song.
+     *
+     * By default the player threads finish after the last song.
+     * Keep alive is enabled for the [ControlServer](@ref ControlServer), and disabling it finishes the
+     * playlist once the enqueued songs are played.\n
+     * Disabling it waits until the songs being prepared are in the inbox, so none of them is dropped.
+     * @param keepAlive is true to wait for the songs.
+     ****************************************************************************************************/
+    void setKeepAlive(const bool keepAlive);
+
+    /** @brief sets the listener of the play events (default `NULL`), it must be set before the playlist starts and outlive it. */
+    void setListener(PlaylistListener *listener);
+
+    /** @brief number of the songs which are not started yet (including the enqueued songs). */
+    size_t getPendingSongs() const;
+
 private:
 
     /** @brief logger is a pointer to logger class's singleton object. */
     Logger *logger;
 
+    /** @brief clock is used to wait until the song is completed. */
+    PlayerClock *clock;
+
+    /** @brief renderer whose volume is set to the loudness gain of the song, or `NULL`. */
+    AudioRenderer *renderer;
+
+    /** @brief listener of the play events, or `NULL`. */
+    PlaylistListener *listener;
+
+    /** @brief screenOutput determines whether to clear the screen and display the song details or not. */
+    bool screenOutput;
+
     /** @brief songPlaying is the boolean that indicates either any song is being played or not. */
-    bool songPlaying;
+    std::atomic<bool> songPlaying;
 
     /************************************************************************//**
      * @brief executionComplete flag indicates if all songs are completed or not.
@@ -87,7 +215,7 @@ private:
      * This flag is specially used into monitorException().
      * If it's true, then error thread can end it's waiting to complete execution.
      ***************************************************************************/
-    bool executionComplete;
+    std::atomic<bool> executionComplete;
 
     /************************************************************************************************************//**
      * @brief errorMessage is used to store error message if any exception occurs during the execution.
@@ -109,19 +237,71 @@ private:
      *
      * It is used with the `unique_lock` and `condition_variable` to make thread wait and awake them.
      **********************************************************************************************/
-    std::mutex _lock_;
+    PlayerMutex _lock_;
 
     /** @brief songCondition is the condition variable to synchronize the display and pop thread. */
-    std::condition_variable songCondition;
+    PlayerConditionVariable songCondition;
 
     /*******************************************************//**
      * @brief used to send error monitoring thread into waiting,
      * and wake error thread back from the sleep.
      **********************************************************/
-    std::condition_variable errorRaised;
+    PlayerConditionVariable errorRaised;
 
     /** @brief playlist represents the song playlist which holds the songs to be played. */
-    std::queue<Song> playlist;
+    RingQueue<Song> playlist;
+
+    /*****************************************************************************************************//**
+     * @brief prepareSong builds the seek table and resolves the loudness gain of the song, when it is queued.
+     *
+     * So the player never scans an audio file or looks up a cache while it holds `_lock_`.
+     ********************************************************************************************************/
+    void prepareSong(Song &song);
+
+    /** @brief moves the enqueued songs from the inbox into the playlist, `_lock_` must be held. */
+    void takeInbox();
+
+    /** @brief keepAlive tells whether the player threads wait for enqueued songs after the last song. */
+    std::atomic<bool> keepAlive;
+
+    /** @brief unprepared holds the enqueued songs, until the preparer thread moves them into `inbox`. */
+    std::vector<Song> unprepared;
+
+    /** @brief number of the songs in `unprepared` and being prepared, under `inbox_lock`. */
+    size_t preparingSongs;
+
+    /** @brief preparer is the thread which prepares the enqueued songs, started by the first enqueueSong(). */
+    std::thread preparer;
+
+    /** @brief preparerStopped tells the preparer thread to finish, under `inbox_lock`. */
+    bool preparerStopped;
+
+    /** @brief preparerCondition wakes the preparer thread (on `inbox_lock`) when songs are enqueued. */
+    PlayerConditionVariable preparerCondition;
+
+    /** @brief prepareSongs is the body of the preparer thread. */
+    void prepareSongs();
+
+    /** @brief inbox holds the prepared songs enqueued while the playlist is playing. */
+    std::vector<Song> inbox;
+
+    /** @brief inboxPending is true if the inbox has songs, so the player threads don't lock an empty inbox. */
+    std::atomic<bool> inboxPending;
+
+    /** @brief inbox_lock protects `inbox`, it is never held along with a wait for the song. */
+    PlayerMutex inbox_lock;
+
+    /** @brief inboxCondition wakes the player waiting (on `inbox_lock`) for the enqueued songs in keep alive mode, and setKeepAlive() waiting for the preparer. */
+    PlayerConditionVariable inboxCondition;
+
+    /** @brief wakes the player waiting for the enqueued songs, after `keepAlive` or `executionComplete` is changed. */
+    void wakeIdlePlayer();
+
+    /** @brief sets `executionComplete` and wakes all the waiting threads, `_lock_` must not be held. */
+    void completeExecution();
+
+    /** @brief number of the songs which are not started yet. */
+    std::atomic<size_t> pendingSongs;
 };
 
 #endif // DISPLAYDATA_H
@@ -0,0 +1,141 @@
+#include "fft.h"
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/* ========== CONSTRUCTOR ===========*/
+RealFft::RealFft(const size_t size)
+{
+    if(size < 8 || (size & (size - 1)) != 0)
+        throw invalid_argument("FFT size must be a power of two, at least 8");
+
+    length = size;
+    half = size / 2;
+
+    unsigned int bits = 0;
+    while((size_t(1) << bits) < half)
+        bits++;
+    bitReversed.resize(half);
+    for(size_t i=0; i<half; i++){
+        unsigned int reversed = 0;
+        for(unsigned int bit=0; bit<bits; bit++)
+            if(i & (size_t(1) << bit))
+                reversed |= 1u << (bits - 1 - bit);
+        bitReversed[i] = reversed;
+    }
+
+    // stage with h butterflies per group uses e^(-2*pi*i*k/(2h)), k < h, stored from index h-1
+    twiddleReal.resize(half);
+    twiddleImaginary.resize(half);
+    for(size_t h=1; h<half; h*=2)
+        for(size_t k=0; k<h; k++){
+            double angle = -M_PI * k / h;
+            twiddleReal[h-1+k] = static_cast<float>(cos(angle));
+            twiddleImaginary[h-1+k] = static_cast<float>(sin(angle));
+        }
+
+    splitReal.resize(half + 1);
+    splitImaginary.resize(half + 1);
+    for(size_t k=0; k<=half; k++){
+        double angle = -2 * M_PI * k / length;
+        splitReal[k] = static_cast<float>(cos(angle));
+        splitImaginary[k] = static_cast<float>(sin(angle));
+    }
+
+    workReal.resize(half);
+    workImaginary.resize(half);
+}
+
+size_t RealFft::size() const {
+    return length;
+}
+
+
+/* ============= TRANSFORM ==============*/
+void RealFft::transform(const float *input, float *real, float *imaginary)
+{
+    // even samples are the real part and odd samples are the imaginary part of the complex input
+    for(size_t i=0; i<half; i++){
+        workReal[bitReversed[i]] = input[2*i];
+        workImaginary[bitReversed[i]] = input[2*i + 1];
+    }
+
+    complexTransform();
+
+    // split the spectrum of the even samples (E) and the odd samples (O): X[k] = E[k] + e^(-2*pi*i*k/N) * O[k]
+    for(size_t k=0; k<=half; k++){
+        size_t mirror = (half - k) % half;
+        size_t index = k % half;
+        float a = workReal[index], b = workImaginary[index];
+        float c = workReal[mirror], d = workImaginary[mirror];
+
+        float evenReal = 0.5f * (a + c), evenImaginary = 0.5f * (b - d);
+        float oddReal = 0.5f * (b + d), oddImaginary = 0.5f * (c - a);
+
+        real[k] = evenReal + splitReal[k]*oddReal - splitImaginary[k]*oddImaginary;
+        imaginary[k] = evenImaginary + splitReal[k]*oddImaginary + splitImaginary[k]*oddReal;
+    }
+}
+
+void RealFft::complexTransform()
+{
+    float *re = workReal.data();
+    float *im = workImaginary.data();
+
+    for(size_t h=1; h<half; h*=2)
+    {
+        const float *wre = twiddleReal.data() + h - 1;
+        const float *wim = twiddleImaginary.data() + h - 1;
+
+        for(size_t group=0; group<half; group+=2*h)
+        {
+            size_t k = 0;
+#if defined(__AVX__)
+            for(; k + 8 <= h; k += 8){
+                float *ar = re + group + k, *ai = im + group + k;
+                float *br = ar + h, *bi = ai + h;
+                __m256 wr = _mm256_loadu_ps(wre + k), wi = _mm256_loadu_ps(wim + k);
+                __m256 xr = _mm256_loadu_ps(br), xi = _mm256_loadu_ps(bi);
+                __m256 tr = _mm256_sub_ps(_mm256_mul_ps(xr, wr), _mm256_mul_ps(xi, wi));
+                __m256 ti = _mm256_add_ps(_mm256_mul_ps(xr, wi), _mm256_mul_ps(xi, wr));
+                __m256 yr = _mm256_loadu_ps(ar), yi = _mm256_loadu_ps(ai);
+                _mm256_storeu_ps(ar, _mm256_add_ps(yr, tr));
+                _mm256_storeu_ps(ai, _mm256_add_ps(yi, ti));
+                _mm256_storeu_ps(br, _mm256_sub_ps(yr, tr));
+                _mm256_storeu_ps(bi, _mm256_sub_ps(yi, ti));
+            }
+#endif
+#if defined(__SSE2__)
+            for(; k + 4 <= h; k += 4){
+                float *ar = re + group + k, *ai = im + group + k;
+                float *br = ar + h, *bi = ai + h;
+                __m128 wr = _mm_loadu_ps(wre + k), wi = _mm_loadu_ps(wim + k);
+                __m128 xr = _mm_loadu_ps(br), xi = _mm_loadu_ps(bi);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+                __m128 yr = _mm_loadu_ps(ar), yi = _mm_loadu_ps(ai);
+                _mm_storeu_ps(ar, _mm_add_ps(yr, tr));
+                _mm_storeu_ps(ai, _mm_add_ps(yi, ti));
+                _mm_storeu_ps(br, _mm_sub_ps(yr, tr));
+                _mm_storeu_ps(bi, _mm_sub_ps(yi, ti));
+            }
+#endif
+            for(; k < h; k++){
+                size_t a = group + k, b = a + h;
+                float tr = re[b]*wre[k] - im[b]*wim[k];
+                float ti = re[b]*wim[k] + im[b]*wre[k];
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
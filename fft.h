@@ -0,0 +1,82 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+#include <cstddef>
+
+
+/*********************************************************************************************************//**
+ * @class RealFft
+ * @brief RealFft computes the FFT of real samples, i.e. for the spectrum of the audio.
+ *
+ * A real FFT of `N` samples is computed as a complex FFT of `N/2` points (even samples as real part,
+ * odd samples as imaginary part), followed by a split step which separates the two halves.\n
+ * Complex FFT is an iterative radix-2 FFT, with the data stored in split format (separate real and
+ * imaginary arrays), so that the butterflies of a stage work on consecutive floats:
+ * 1. with AVX (compiled with `-mavx`), 8 butterflies are computed at once.
+ * 2. with SSE (always available on x86-64), 4 butterflies are computed at once.
+ * 3. otherwise, and for the first two stages, butterflies are scalar.
+ * .
+ * Twiddle factors and bit reversal permutation are computed once in the constructor,
+ * and all the buffers are allocated there, so `transform()` never allocates.
+ ************************************************************************************************************/
+class RealFft
+{
+public:
+
+    /*************************************************************************//**
+     * @brief RealFft prepares the twiddles and buffers.
+     * @param size is the number of real samples, a power of two (at least 8).
+     ****************************************************************************/
+    RealFft(const size_t size);
+
+    /***********************************************************************************************//**
+     * @brief transform computes the spectrum of the real samples.
+     * @param input has `size` real samples.
+     * @param real is filled with `size/2 + 1` real parts of the bins (0 to Nyquist).
+     * @param imaginary is filled with `size/2 + 1` imaginary parts of the bins.
+     **************************************************************************************************/
+    void transform(const float *input, float *real, float *imaginary);
+
+    /** @brief number of real samples of the transform. */
+    size_t size() const;
+
+private:
+
+    /** @brief runs the butterflies of the complex FFT on `workReal` and `workImaginary`. */
+    void complexTransform();
+
+    /** @brief number of real samples. */
+    size_t length;
+
+    /** @brief number of points of the complex FFT (`length/2`). */
+    size_t half;
+
+    /** @brief bitReversed[i] is the position of the element i after bit reversal permutation. */
+    std::vector<unsigned int> bitReversed;
+
+    /*
+     * twiddles of all the stages are stored one after another,
+     * stage with `h` butterflies per group uses `h` twiddles starting at index `h-1`.
+     */
+
+    /** @brief real part of the twiddles of the complex FFT. */
+    std::vector<float> twiddleReal;
+
+    /** @brief imaginary part of the twiddles of the complex FFT. */
+    std::vector<float> twiddleImaginary;
+
+    /** @brief real part of the twiddles of the split step (e^(-2*pi*i*k/length)). */
+    std::vector<float> splitReal;
+
+    /** @brief imaginary part of the twiddles of the split step. */
+    std::vector<float> splitImaginary;
+
+    /** @brief real part of the working buffer of the complex FFT. */
+    std::vector<float> workReal;
+
+    /** @brief imaginary part of the working buffer of the complex FFT. */
+    std::vector<float> workImaginary;
+};
+
+#endif // FFT_H
@@ -0,0 +1,342 @@
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>         // for close()
+#include <sys/socket.h>
+#include <sys/un.h>         // for sockaddr_un
+#include <sys/epoll.h>
+#include <sys/resource.h>   // for setrlimit()
+#include "controlprotocol.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace ControlProtocol;
+
+/** @brief Options are the command line options of the load generator. */
+struct Options {
+    /** @brief path of the socket of the server. */
+    string socketPath = "music_player.sock";
+    /** @brief number of the connections sending requests. */
+    size_t connections = 1000;
+    /** @brief number of the connections subscribed to the play events. */
+    size_t subscribers = 0;
+    /** @brief total number of the requests. */
+    unsigned long long requests = 100000;
+    /** @brief percentage of `ENQUEUE` requests, the others are `STATUS`. */
+    unsigned int enqueuePercent = 10;
+    /** @brief duration of the enqueued songs in seconds. */
+    unsigned int songSeconds = 0;
+    /** @brief number of the client threads. */
+    unsigned int threads = 1;
+};
+
+/** @brief Client is a connection to the server, with at most one request in flight. */
+struct Client {
+    /** @brief socket of the connection, -1 if it failed. */
+    int fd;
+    /** @brief subscriber tells whether the client only receives events. */
+    bool subscriber;
+    /** @brief sequence of the request in flight, 0 if none. */
+    uint32_t sequence;
+    /** @brief time at which the request in flight was sent. */
+    steady_clock::time_point sentAt;
+    /** @brief received bytes, which are not a complete message yet. */
+    char input[8 * 1024];
+    /** @brief number of the bytes in `input`. */
+    size_t inputUsed;
+};
+
+/** @brief Result of a client thread. */
+struct Result {
+    /** @brief latency of every request in nanoseconds. */
+    vector<uint64_t> latencies;
+    /** @brief number of the requests answered by `ERROR` or failed to send. */
+    unsigned long long errors = 0;
+    /** @brief number of the events received by the subscribers. */
+    unsigned long long events = 0;
+    /** @brief failure of the thread, i.e. the server stopped answering. */
+    string failure;
+};
+
+/*****************************************************************************************************//**
+ * @brief usage displays the command line options of the loadgen tool.
+ * @param program is the name of the executable.
+ ********************************************************************************************************/
+void usage(const char *program);
+
+/** @brief connects to the server (blocking, so that a full accept queue makes it wait instead of failing). */
+int connectToServer(const string &socketPath);
+
+/*****************************************************************************************************//**
+ * @brief sendRequest sends the next request of the client.
+ * @return false if the request could not be sent.
+ ********************************************************************************************************/
+bool sendRequest(Client &client, const Options &options, uint32_t &sequence, uint64_t &random);
+
+/*****************************************************************************************************//**
+ * @brief runClients drives the clients with epoll until `quota` requests are answered.
+ * @param clients are the connections of this thread.
+ * @param options are the command line options.
+ * @param quota is the number of the requests of this thread.
+ * @param result is filled with the latencies, errors and events.
+ ********************************************************************************************************/
+void runClients(vector<Client> &clients, const Options &options, const unsigned long long quota, Result &result);
+
+/*****************************************************************************************************//**
+ * @brief main method of the loadgen tool, which measures the [ControlServer](@ref ControlServer) of the player.
+ *
+ * **Example**\n
+ * Music_Player --serve music_player.sock &\n
+ * loadgen --connections 2000 --requests 500000 --subscribers 10 music_player.sock
+ *
+ * Every connection sends one request at a time (closed loop), so the latency includes the queueing in the server.\n
+ * At the end, it displays the requests per second and the latency percentiles.
+ * @return 0 if all the requests are answered without error, else returns 1.
+ ********************************************************************************************************/
+int main(int argc, char *argv[])
+{
+    Options options;
+    bool socketGiven = false;
+    for(int i=1; i<argc; i++)
+    {
+        bool hasValue = i+1 < argc;
+        if(strcmp(argv[i], "--connections") == 0 && hasValue)
+            options.connections = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--subscribers") == 0 && hasValue)
+            options.subscribers = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--requests") == 0 && hasValue)
+            options.requests = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--enqueue") == 0 && hasValue)
+            options.enqueuePercent = min(100ul, strtoul(argv[++i], NULL, 10));
+        else if(strcmp(argv[i], "--song-seconds") == 0 && hasValue)
+            options.songSeconds = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--threads") == 0 && hasValue)
+            options.threads = max(1ul, strtoul(argv[++i], NULL, 10));
+        else if(argv[i][0] != '-' && !socketGiven){
+            options.socketPath = argv[i];
+            socketGiven = true;
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(options.connections == 0 || options.requests == 0){
+        usage(argv[0]);
+        return 1;
+    }
+    options.threads = static_cast<unsigned int>(min<size_t>(options.threads, options.connections));
+
+    // every connection needs a file descriptor, so the soft limit is raised up to the hard limit.
+    rlimit limit;
+    size_t descriptors = options.connections + options.subscribers + 64;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < descriptors){
+        limit.rlim_cur = min<rlim_t>(limit.rlim_max, descriptors);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // ---------- connect, and distribute the connections to the threads ----------
+    vector<vector<Client>> clients(options.threads);
+    for(size_t i=0; i < options.connections + options.subscribers; i++){
+        int fd = connectToServer(options.socketPath);
+        if(fd < 0){
+            cerr << "Failed to connect to '" << options.socketPath << "' (connection " << i+1 << "): " << strerror(errno) << endl;
+            return 1;
+        }
+        vector<Client> &group = clients[i % options.threads];
+        group.emplace_back();
+        Client &client = group.back();
+        client.fd = fd;
+        client.subscriber = i >= options.connections;
+        client.sequence = 0;
+        client.inputUsed = 0;
+    }
+
+    // ---------- run ----------
+    vector<Result> results(options.threads);
+    vector<thread> threads;
+    steady_clock::time_point begin = steady_clock::now();
+    for(unsigned int t=0; t<options.threads; t++){
+        unsigned long long quota = options.requests / options.threads + (t < options.requests % options.threads ? 1 : 0);
+        threads.emplace_back(runClients, ref(clients[t]), cref(options), quota, ref(results[t]));
+    }
+    for(thread &t : threads)
+        t.join();
+    double wallSeconds = duration<double>(steady_clock::now() - begin).count();
+
+    for(vector<Client> &group : clients)
+        for(Client &client : group)
+            if(client.fd >= 0)
+                close(client.fd);
+
+    // ---------- report ----------
+    vector<uint64_t> latencies;
+    unsigned long long errors = 0, events = 0;
+    for(Result &result : results){
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+        events += result.events;
+        if(!result.failure.empty())
+            cerr << result.failure << endl;
+    }
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double fraction){
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()))] / 1000.0;
+    };
+
+    printf("\n  ===== LOAD TEST =====\n");
+    printf("\tConnections   : %zu (+%zu subscribers), %u threads\n", options.connections, options.subscribers, options.threads);
+    printf("\tRequests      : %zu answered, %llu errors\n", latencies.size(), errors);
+    printf("\tWall time     : %.3f seconds\n", wallSeconds);
+    printf("\tThroughput    : %.0f requests/second\n", latencies.size() / wallSeconds);
+    printf("\tLatency (us)  : p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), percentile(1.0));
+    if(options.subscribers > 0)
+        printf("\tEvents        : %llu received by the subscribers\n", events);
+    return (errors == 0 && latencies.size() == options.requests) ? 0 : 1;
+}
+
+void usage(const char *program)
+{
+    cerr << "Usage: " << program << " [options] [socket path]\n"
+         << "  --connections N     connections sending requests (default 1000)\n"
+         << "  --subscribers N     connections subscribed to the play events (default 0)\n"
+         << "  --requests N        total number of requests (default 100000)\n"
+         << "  --enqueue PERCENT   percentage of enqueue requests, others are status (default 10)\n"
+         << "  --song-seconds N    duration of the enqueued songs (default 0)\n"
+         << "  --threads N         client threads (default 1)\n"
+         << "Socket path is 'music_player.sock' by default." << endl;
+}
+
+int connectToServer(const string &socketPath)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+bool sendRequest(Client &client, const Options &options, uint32_t &sequence, uint64_t &random)
+{
+    // xorshift, so that the mix of the requests does not depend on a locked generator
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+
+    char message[sizeof(Header) + sizeof(EnqueueRequest) + 64];
+    size_t length;
+    client.sequence = ++sequence;
+    if(random % 100 < options.enqueuePercent){
+        // a small set of names, the player frees the (owned) strings of every enqueued song after it is played
+        const char thumbnail[] = "/thumbnails/load_test.jpeg";
+        char strings[64];
+        int nameLength = snprintf(strings, sizeof(strings), "Load test song %u", static_cast<unsigned int>(random % 100));
+        memcpy(strings + nameLength, thumbnail, sizeof(thumbnail) - 1);
+        EnqueueRequest request = {options.songSeconds, static_cast<uint16_t>(nameLength),
+                                  static_cast<uint16_t>(sizeof(thumbnail) - 1), 0, 0};
+        length = encode(message, ENQUEUE, OK, client.sequence, &request, sizeof(request),
+                        strings, nameLength + sizeof(thumbnail) - 1);
+    }
+    else
+        length = encode(message, STATUS, OK, client.sequence, NULL, 0);
+
+    client.sentAt = steady_clock::now();
+    // a request is far smaller than the socket buffer and only one is in flight, so a short write is an error
+    return send(client.fd, message, length, MSG_NOSIGNAL) == static_cast<ssize_t>(length);
+}
+
+void runClients(vector<Client> &clients, const Options &options, const unsigned long long quota, Result &result)
+{
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    uint64_t random = 0x9E3779B97F4A7C15ULL ^ reinterpret_cast<uintptr_t>(&clients);
+    uint32_t sequence = 0;
+    unsigned long long issued = 0, completed = 0;
+    result.latencies.reserve(quota);
+
+    for(uint32_t i=0; i<clients.size(); i++){
+        Client &client = clients[i];
+        epoll_event event = {EPOLLIN | EPOLLET, {.u32 = i}};
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &event);
+        if(client.subscriber){
+            char message[sizeof(Header)];
+            size_t length = encode(message, SUBSCRIBE, OK, 0, NULL, 0);
+            if(send(client.fd, message, length, MSG_NOSIGNAL) != static_cast<ssize_t>(length))
+                result.errors++;
+        }
+        else if(issued < quota){
+            issued++;
+            if(!sendRequest(client, options, sequence, random)){
+                result.errors++;
+                completed++;
+                client.sequence = 0;
+            }
+        }
+    }
+
+    epoll_event ready[256];
+    while(completed < quota)
+    {
+        int count = epoll_wait(epollFd, ready, 256, 5000);
+        if(count == 0){
+            result.failure = "Server did not answer for 5 seconds";
+            break;
+        }
+        for(int e=0; e<count; e++)
+        {
+            Client &client = clients[ready[e].data.u32];
+            while(true){ // edge-triggered, read until EAGAIN
+                ssize_t received = recv(client.fd, client.input + client.inputUsed, sizeof(client.input) - client.inputUsed, MSG_DONTWAIT);
+                if(received <= 0)
+                    break;
+                client.inputUsed += received;
+
+                size_t offset = 0;
+                Header header;
+                while(client.inputUsed - offset >= sizeof(Header)
+                      && (memcpy(&header, client.input + offset, sizeof(header)), client.inputUsed - offset >= sizeof(Header) + header.length))
+                {
+                    offset += sizeof(Header) + header.length;
+                    if(header.type == EVENT){
+                        result.events++;
+                        continue;
+                    }
+                    if(client.subscriber || header.sequence != client.sequence)
+                        continue; // reply of SUBSCRIBE
+
+                    result.latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - client.sentAt).count());
+                    if(header.type == ERROR)
+                        result.errors++;
+                    completed++;
+                    client.sequence = 0;
+                    if(issued < quota){
+                        issued++;
+                        if(!sendRequest(client, options, sequence, random)){
+                            result.errors++;
+                            completed++;
+                            client.sequence = 0;
+                        }
+                    }
+                }
+                client.inputUsed -= offset;
+                memmove(client.input, client.input + offset, client.inputUsed);
+            }
+        }
+    }
+    close(epollFd);
+}
@@ -0,0 +1,307 @@
+#include "logcodec.h"
+#include <cstring>  // for memcpy(), memcmp()
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+/* minimum length of a match, shorter matches are written as literals. */
+static const size_t MIN_MATCH = 4;
+
+/* maximum distance of a match, offsets are written in 2 bytes. */
+static const size_t MAX_OFFSET = 65535;
+
+/* number of bits of the hash table of the compressor. */
+static const int HASH_BITS = 14;
+
+static inline uint32_t read32(const char *data){
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash32(const uint32_t value){
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline void writeLittleEndian32(char *output, const uint32_t value){
+    for(int i=0; i<4; i++)
+        output[i] = static_cast<char>((value >> (8*i)) & 0xFF);
+}
+
+static inline uint32_t readLittleEndian32(const char *input){
+    uint32_t value = 0;
+    for(int i=0; i<4; i++)
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(input[i])) << (8*i);
+    return value;
+}
+
+/* writes the part of the length, which does not fit into the 4 bits of the token. */
+static inline char* writeExtraLength(char *output, size_t length){
+    while(length >= 255){
+        *output++ = static_cast<char>(255);
+        length -= 255;
+    }
+    *output++ = static_cast<char>(length);
+    return output;
+}
+
+/* writes a sequence of literals followed by a match, matchLength 0 means only literals (last sequence). */
+static char* writeSequence(char *output, const char *literals, const size_t literalLength, const size_t offset, const size_t matchLength)
+{
+    char *token = output++;
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+
+    *token = static_cast<char>(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if(literalLength >= 15)
+        output = writeExtraLength(output, literalLength - 15);
+    memcpy(output, literals, literalLength);
+    output += literalLength;
+
+    if(matchLength){
+        *output++ = static_cast<char>(offset & 0xFF);
+        *output++ = static_cast<char>(offset >> 8);
+        if(matchCode >= 15)
+            output = writeExtraLength(output, matchCode - 15);
+    }
+    return output;
+}
+
+
+/* ============= CODEC ==============*/
+size_t LogCodec::maxCompressedSize(const size_t size){
+    return size + size/255 + 16;
+}
+
+size_t LogCodec::compress(const char *input, const size_t size, char *output)
+{
+    // table stores (position+1) of the last 4 bytes with the same hash, 0 means empty.
+    uint32_t table[1 << HASH_BITS] = {0};
+
+    char *out = output;
+    size_t anchor = 0;   // first literal not written yet
+    size_t position = 0;
+    size_t limit = size >= MIN_MATCH ? size - MIN_MATCH : 0;
+
+    while(position < limit)
+    {
+        uint32_t sequence = read32(input + position);
+        uint32_t &entry = table[hash32(sequence)];
+        size_t candidate = entry;
+        entry = static_cast<uint32_t>(position + 1);
+
+        if(candidate == 0 || position - (candidate-1) > MAX_OFFSET || read32(input + candidate-1) != sequence){
+            // skip faster through the data which does not compress.
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+        candidate--;
+
+        size_t matchLength = MIN_MATCH;
+        while(position + matchLength < size && input[candidate + matchLength] == input[position + matchLength])
+            matchLength++;
+
+        // extend the match backward into the pending literals.
+        while(position > anchor && candidate > 0 && input[position-1] == input[candidate-1]){
+            position--;
+            candidate--;
+            matchLength++;
+        }
+
+        out = writeSequence(out, input + anchor, position - anchor, position - candidate, matchLength);
+        position += matchLength;
+        anchor = position;
+
+        if(position >= 2 && position < limit)
+            table[hash32(read32(input + position-2))] = static_cast<uint32_t>(position-2 + 1);
+    }
+
+    out = writeSequence(out, input + anchor, size - anchor, 0, 0);
+    return out - output;
+}
+
+bool LogCodec::decompress(const char *input, const size_t size, char *output, const size_t rawSize)
+{
+    const unsigned char *in = reinterpret_cast<const unsigned char*>(input);
+    const unsigned char *inEnd = in + size;
+    char *out = output;
+    char *outEnd = output + rawSize;
+
+    while(in < inEnd)
+    {
+        unsigned char token = *in++;
+
+        size_t literalLength = token >> 4;
+        if(literalLength == 15){
+            unsigned char extra;
+            do {
+                if(in >= inEnd) return false;
+                extra = *in++;
+                literalLength += extra;
+            } while(extra == 255);
+        }
+        if(literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out))
+            return false;
+        memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        if(in == inEnd) // last sequence has only literals
+            break;
+
+        if(inEnd - in < 2) return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if(offset == 0 || offset > static_cast<size_t>(out - output))
+            return false;
+
+        size_t matchLength = token & 15;
+        if(matchLength == 15){
+            unsigned char extra;
+            do {
+                if(in >= inEnd) return false;
+                extra = *in++;
+                matchLength += extra;
+            } while(extra == 255);
+        }
+        matchLength += MIN_MATCH;
+        if(matchLength > static_cast<size_t>(outEnd - out))
+            return false;
+
+        const char *match = out - offset;
+        if(offset >= matchLength){
+            memcpy(out, match, matchLength);
+            out += matchLength;
+        }
+        else { // overlapping match repeats the last `offset` bytes
+            for(size_t i=0; i<matchLength; i++)
+                *out++ = match[i];
+        }
+    }
+    return out == outEnd;
+}
+
+uint32_t LogCodec::checksum(const char *data, const size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for(size_t i=0; i<size; i++){
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/* ============= BLOCKS ==============*/
+void LogCodec::encodeBlock(const char *data, const size_t size, vector<char> &block)
+{
+    // larger data is split, since readers reject a block of more than MAX_BLOCK_SIZE bytes.
+    size_t done = 0;
+    do {
+        const char *part = data + done;
+        size_t partSize = min(size - done, MAX_BLOCK_SIZE);
+
+        size_t begin = block.size();
+        block.resize(begin + HEADER_SIZE + maxCompressedSize(partSize));
+        char *header = block.data() + begin;
+        char *payload = header + HEADER_SIZE;
+
+        uint32_t storedSize = static_cast<uint32_t>(compress(part, partSize, payload));
+        if(storedSize >= partSize){ // data does not compress, so store it as it is.
+            memcpy(payload, part, partSize);
+            storedSize = static_cast<uint32_t>(partSize) | RAW_FLAG;
+        }
+
+        memcpy(header, MAGIC, sizeof(MAGIC));
+        writeLittleEndian32(header+4, static_cast<uint32_t>(partSize));
+        writeLittleEndian32(header+8, storedSize);
+        writeLittleEndian32(header+12, checksum(part, partSize));
+        block.resize(begin + HEADER_SIZE + (storedSize & ~RAW_FLAG));
+
+        done += partSize;
+    } while(done < size);
+}
+
+bool LogCodec::readHeader(const char *data, BlockHeader &header)
+{
+    if(memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+        return false;
+    header.rawSize = readLittleEndian32(data+4);
+    header.storedSize = readLittleEndian32(data+8);
+    header.checksum = readLittleEndian32(data+12);
+
+    uint32_t payloadSize = header.storedSize & ~RAW_FLAG;
+    if(header.rawSize > MAX_BLOCK_SIZE || payloadSize > maxCompressedSize(MAX_BLOCK_SIZE))
+        return false;
+    return !(header.storedSize & RAW_FLAG) || payloadSize == header.rawSize;
+}
+
+bool LogCodec::isCompressed(const char *data, const size_t size)
+{
+    BlockHeader header;
+    return size >= HEADER_SIZE && readHeader(data, header);
+}
+
+bool LogCodec::decompressAll(const char *data, const size_t size, vector<char> &output, unsigned int threads)
+{
+    struct Block {
+        size_t input;   // offset of the payload in the data
+        size_t output;  // offset of the uncompressed data in the output
+        BlockHeader header;
+    };
+
+    // headers give the size of each block, so blocks are found by jumping from header to header.
+    vector<Block> blocks;
+    size_t offset = 0, outputSize = 0;
+    while(size - offset >= HEADER_SIZE)
+    {
+        Block block;
+        if(!readHeader(data + offset, block.header))
+            return false;
+        size_t payloadSize = block.header.storedSize & ~RAW_FLAG;
+        if(size - offset - HEADER_SIZE < payloadSize) // incomplete last block, the logger is still writing it.
+            break;
+
+        block.input = offset + HEADER_SIZE;
+        block.output = outputSize;
+        blocks.push_back(block);
+        offset += HEADER_SIZE + payloadSize;
+        outputSize += block.header.rawSize;
+    }
+    output.resize(outputSize);
+
+    if(threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    if(threads > blocks.size())
+        threads = max<size_t>(1, blocks.size());
+
+    atomic<size_t> nextBlock(0);
+    atomic<bool> valid(true);
+    auto worker = [&](){
+        for(size_t i = nextBlock++; i < blocks.size() && valid; i = nextBlock++)
+        {
+            const Block &block = blocks[i];
+            const char *payload = data + block.input;
+            char *raw = output.data() + block.output;
+            bool decoded;
+            if(block.header.storedSize & RAW_FLAG){
+                memcpy(raw, payload, block.header.rawSize);
+                decoded = true;
+            }
+            else
+                decoded = decompress(payload, block.header.storedSize, raw, block.header.rawSize);
+
+            if(!decoded || checksum(raw, block.header.rawSize) != block.header.checksum)
+                valid = false;
+        }
+    };
+
+    vector<thread> workers;
+    for(unsigned int i=1; i<threads; i++)
+        workers.emplace_back(worker);
+    worker();
+    for(thread &t : workers)
+        t.join();
+    return valid;
+}
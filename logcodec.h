@@ -0,0 +1,119 @@
+#ifndef LOGCODEC_H
+#define LOGCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/*********************************************************************************************************//**
+ * @namespace LogCodec
+ * @brief LogCodec is a small LZ77 codec (similar to LZ4) used to compress the log files block by block.
+ *
+ * Compressed log file is a sequence of independent blocks, each block is
+ * 1. [BlockHeader](@ref LogCodec::BlockHeader) of `HEADER_SIZE` bytes
+ * 2. payload of `storedSize` bytes (compressed data, or raw data if it could not be compressed)
+ * .
+ * Since each block has its own header and does not refer to any other block,
+ * readers can skip from header to header, and decompress the blocks in parallel.\n
+ * Sequences are encoded like LZ4: a token (4 bits literal length, 4 bits match length),
+ * extra length bytes, literals, 2 bytes offset and extra match length bytes.
+ ************************************************************************************************************/
+namespace LogCodec
+{
+    /** @brief size of the `BlockHeader` written in the file. */
+    static const size_t HEADER_SIZE = 16;
+
+    /** @brief maximum size of the uncompressed data of a block. */
+    static const size_t MAX_BLOCK_SIZE = 4*1024*1024;
+
+    /** @brief magic bytes at the beginning of every block header. */
+    static const char MAGIC[4] = {'L','Z','L','B'};
+
+    /** @brief bit of `BlockHeader::storedSize` which indicates that the payload is stored uncompressed. */
+    static const uint32_t RAW_FLAG = 0x80000000u;
+
+    /*******************************************************************//**
+     * @brief The BlockHeader struct describes one block of the compressed log.
+     *
+     * It is written as 4 magic bytes followed by 3 little endian `uint32_t`.
+     **********************************************************************/
+    struct BlockHeader
+    {
+        /** @brief size of the uncompressed data. */
+        uint32_t rawSize;
+
+        /** @brief size of the payload after the header, with `RAW_FLAG` if payload is not compressed. */
+        uint32_t storedSize;
+
+        /** @brief FNV-1a hash of the uncompressed data, to detect corrupted blocks. */
+        uint32_t checksum;
+    };
+
+    /*******************************************************************************//**
+     * @brief maxCompressedSize returns the size needed to compress `size` bytes.
+     * @param size is the number of bytes to compress.
+     * @return maximum size of the compressed data (in the worst case).
+     **********************************************************************************/
+    size_t maxCompressedSize(const size_t size);
+
+    /*********************************************************************************************//**
+     * @brief compress compresses the `input` into the `output`.
+     * @param input is the data to compress.
+     * @param size is the number of bytes of `input`.
+     * @param output must have at least `maxCompressedSize(size)` bytes.
+     * @return number of bytes written into the `output`.
+     ************************************************************************************************/
+    size_t compress(const char *input, const size_t size, char *output);
+
+    /*********************************************************************************************//**
+     * @brief decompress decompresses the `input` into the `output`.
+     * @param input is the compressed data.
+     * @param size is the number of bytes of `input`.
+     * @param output is the buffer for the uncompressed data.
+     * @param rawSize is the exact size of the uncompressed data.
+     * @return true on success, false if the compressed data is corrupted.
+     ************************************************************************************************/
+    bool decompress(const char *input, const size_t size, char *output, const size_t rawSize);
+
+    /*****************************************************//**
+     * @brief checksum returns the FNV-1a hash of the data.
+     ********************************************************/
+    uint32_t checksum(const char *data, const size_t size);
+
+    /***************************************************************************************************//**
+     * @brief encodeBlock compresses the data and appends the header and the payload to the `block`.
+     * @param data is the uncompressed data, more than `MAX_BLOCK_SIZE` bytes are split into more blocks.
+     * @param size is the number of bytes of `data`.
+     * @param block is the buffer to which the encoded block is appended.
+     ******************************************************************************************************/
+    void encodeBlock(const char *data, const size_t size, std::vector<char> &block);
+
+    /*********************************************************************************************//**
+     * @brief readHeader parses the block header.
+     * @param data points to the header, it must have at least `HEADER_SIZE` bytes.
+     * @param header is filled with the values of the header.
+     * @return true if the magic bytes and sizes are valid.
+     ************************************************************************************************/
+    bool readHeader(const char *data, BlockHeader &header);
+
+    /*********************************************************************************************//**
+     * @brief isCompressed checks whether the data begins with a compressed block or not.
+     * @param data is the beginning of the file.
+     * @param size is the number of bytes of the `data`.
+     * @return true if it begins with a valid block header.
+     ************************************************************************************************/
+    bool isCompressed(const char *data, const size_t size);
+
+    /*****************************************************************************************************//**
+     * @brief decompressAll decompresses all the blocks of a compressed log, using multiple threads.
+     * @param data is the compressed log.
+     * @param size is the number of bytes of the `data`.
+     * @param output is resized and filled with the uncompressed log.
+     * @param threads is the number of the threads to use (0 means number of cores).
+     * @return true on success, false if any block is corrupted (incomplete last block is ignored).
+     ********************************************************************************************************/
+    bool decompressAll(const char *data, const size_t size, std::vector<char> &output, unsigned int threads = 0);
+}
+
+#endif // LOGCODEC_H
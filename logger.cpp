@@ -1,21 +1,35 @@
 #include "logger.h"
 #include <cstring>  // for strcpy(), strlen() etc.
 #include <sstream>  // to use 'ostringstream' to convert std::thread::id to std::string
-#include <iomanip>  // to use setw(), setfill() etc.
+#include <cstdarg>  // to use va_list in logf()
+#include <algorithm>
+#include "logcodec.h"
 
 /* ========== CONSTRUCTOR - DESTRUCTOR ===========*/
 Logger::Logger(){
+    MUTEX_NAME(get_instance_lock, "Logger::get_instance_lock");
+    MUTEX_NAME(display_lock, "Logger::display_lock");
+    MUTEX_NAME(file_lock, "Logger::file_lock");
+    MUTEX_NAME(compression_lock, "Logger::compression_lock");
+
     priority = trace;
+    clock = PlayerClock::realTime();
     consoleOutput = true;
 
     fileOutput = true;
     filename = new char[9];
     strcpy(filename, "logs.log");
-    file = fopen(filename, "a");
+    file = NULL; // opened by the first log, see openFile()
+    fileOpenFailed = false;
+
+    fileCompression = false;
+    compressing = false;
+    stopCompression = false;
 }
 
 Logger::~Logger(){
     //LOG(trace, "-> Logger destructor called", NULL);
+    disableFileCompression(); // writes the pending compressed logs
     if(file != NULL)
         fclose(file);
     if(filename != NULL)
@@ -24,11 +38,11 @@ Logger::~Logger(){
 
 
 /* ============= STATIC MEMBERS & METHODS ==============*/
-std::mutex Logger::get_instance_lock;
+PlayerMutex Logger::get_instance_lock;
 Logger* Logger::logger = NULL;
 
 Logger* Logger::get(){
-    std::lock_guard<std::mutex> lock(get_instance_lock);
+    std::lock_guard<PlayerMutex> lock(MUTEX_SITE(get_instance_lock));
     if(logger == NULL)
         logger = new Logger();
     return logger;
@@ -44,6 +58,10 @@ LogPriority Logger::getPriority() const{
     return this->priority;
 }
 
+void Logger::setClock(PlayerClock *clock){
+    this->clock = (clock != NULL) ? clock : PlayerClock::realTime();
+}
+
 void Logger::enableConsoleOutput(){
     consoleOutput = true;
 }
@@ -61,13 +79,23 @@ bool Logger::isFileOutputEnabled() const{
 }
 
 void Logger::setFilename(const char *filename){
-    std::lock_guard<std::mutex> lock(file_lock); // locking file before making any change
+    flushCompressedBlocks(); // pending blocks belong to the old file
+    std::lock_guard<PlayerMutex> lock(MUTEX_SITE(file_lock)); // locking file before making any change
 
     if(file) fclose(file);
     delete this->filename;
     this->filename = new char[strlen(filename)+1];
     strcpy(this->filename, filename);
-    file = fopen(filename, "a");
+    file = NULL; // opened by the first log, see openFile()
+    fileOpenFailed = false;
+}
+
+FILE* Logger::openFile(){
+    if(file == NULL && !fileOpenFailed && fileOutput){
+        file = fopen(filename, "a");
+        fileOpenFailed = file == NULL;
+    }
+    return file;
 }
 
 void Logger::enableFileOutput(const char *filename){
@@ -76,11 +104,12 @@ void Logger::enableFileOutput(const char *filename){
         this->setFilename(filename);
     }
     else {
-        std::lock_guard<std::mutex> lock(file_lock); // locking file before making any change
+        std::lock_guard<PlayerMutex> lock(MUTEX_SITE(file_lock)); // locking file before making any change
         if(file != NULL){ // if file is opened, then close it to reopen it.
             fclose(file);
         }
         file = fopen(this->filename, "a");
+        fileOpenFailed = file == NULL;
         if(file == NULL)
         {
             LOG(error, "Failed to open file '" +std::string(this->filename)+ "' to write logs.");
@@ -91,59 +120,285 @@ void Logger::enableFileOutput(const char *filename){
 }
 
 void Logger::disableFileOutput(){
-    std::lock_guard<std::mutex> lock(file_lock); // locking file before making any change
+    flushCompressedBlocks();
+    std::lock_guard<PlayerMutex> lock(MUTEX_SITE(file_lock)); // locking file before making any change
     fileOutput = false;
     if(file != NULL){
         fclose(file);
+        file = NULL;
     }
 }
 
-void Logger::log(const LogPriority &logPriority, const std::thread::id &threadId, const unsigned short _line_number_, const char* _function_name_, const std::string &message)
+/* checks whether compressed blocks can be appended to the file, i.e. it is empty, new or already compressed. */
+static bool acceptsCompressedBlocks(const std::string &filename)
 {
-    using namespace std;
+    FILE *file = fopen(filename.c_str(), "rb");
+    if(file == NULL)
+        return true;
+    char header[LogCodec::HEADER_SIZE];
+    size_t length = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    return length == 0 || LogCodec::isCompressed(header, length);
+}
 
-    // Either consoleOutput or fileOutput must be true.
-    // And log priority also should be equal and greater than Logger's priority.
-    if((consoleOutput || fileOutput) && (logPriority >= this->priority))
+void Logger::enableFileCompression(const char *filename){
+    // compressed blocks must not be mixed with the text logs, so the default file is `<log file>.lz`.
+    std::string compressedFilename = (filename != NULL) ? filename : this->filename;
+    if(filename == NULL && (compressedFilename.size() < 3 || compressedFilename.compare(compressedFilename.size()-3, 3, ".lz") != 0))
+        compressedFilename += ".lz";
+    if(!acceptsCompressedBlocks(compressedFilename)){
+        LOG(error, "Log file '" + compressedFilename + "' contains text logs, compression is not enabled.");
+        return;
+    }
+
+    if(!compressionThread.joinable()){
+        stopCompression = false;
+        compressionThread = std::thread(&Logger::compressBlocks, this);
+    }
+    if(compressedFilename != this->filename)
+        setFilename(compressedFilename.c_str());
     {
-        string logType;
-        switch (logPriority) {
-            case trace:   logType="trace"; break;
-            case debug:   logType="debug"; break;
-            case info:    logType="info "; break;
-            case warning: logType="warn "; break;
-            case error:   logType="error"; break;
-            case fatal:   logType="fatal"; break;
+        std::lock_guard<PlayerMutex> fileLock(MUTEX_SITE(file_lock));
+        std::lock_guard<PlayerMutex> lock(MUTEX_SITE(compression_lock));
+        if(compressionQueue.capacity() < COMPRESSION_BLOCKS){ // blocks are allocated once, then recycled
+            compressionQueue.reserve(COMPRESSION_BLOCKS);
+            freeBlocks.resize(COMPRESSION_BLOCKS-1);
+            for(std::string &block : freeBlocks)
+                block.reserve(COMPRESSION_BLOCK_SIZE);
+            pendingBlock.reserve(COMPRESSION_BLOCK_SIZE);
+        }
+        fileCompression = true;
+    }
+    if(!fileOutput || file == NULL)
+        enableFileOutput();
+}
+
+void Logger::disableFileCompression(){
+    flushCompressedBlocks();
+    {
+        std::lock_guard<PlayerMutex> lock(MUTEX_SITE(file_lock));
+        fileCompression = false;
+    }
+    if(compressionThread.joinable()){
+        {
+            std::lock_guard<PlayerMutex> lock(MUTEX_SITE(compression_lock));
+            stopCompression = true;
         }
+        blockReady.notify_one();
+        compressionThread.join();
+    }
+}
 
-        // ---------- getting current date and time ----------
-        currentTime = time(0);
-        timeStamp = localtime(&currentTime);
-
-        // ---------- getting milliseconds and microseconds for timestamp ----------
-        using namespace chrono;
-        microseconds ms = duration_cast<microseconds>(system_clock::now().time_since_epoch());
-        unsigned long int milliseconds = ms.count()%1000000/1000;
-        unsigned long int microseconds = ms.count()%1000000%1000;
-
-        // ---------- make a complete log message ----------
-        ostringstream logMessage;
-        logMessage << setfill('0') << "[" << timeStamp->tm_year+1900 << "-" << setw(2) << timeStamp->tm_mon+1 << "-" << setw(2) << timeStamp->tm_mday
-        << " " << setw(2) << timeStamp->tm_hour << ":" << setw(2) << timeStamp->tm_min << ":" << setw(2) << timeStamp->tm_sec
-        << "." << setw(3) << milliseconds << "." << setw(3) << microseconds << "]" << setfill(' ')
-        << " ["<<threadId<<"] ["<<logType<<"] ["<<setw(4)<<_line_number_<<"] " << message
-        << " -> ["<<_function_name_<<"] " << endl;
-
-        // ---------- display the log message ----------
-        if(consoleOutput){
-            lock_guard<mutex> lock(display_lock);
-            cout << logMessage.str();
+bool Logger::isFileCompressionEnabled() const{
+    return fileCompression;
+}
+
+bool Logger::queuePendingBlock(std::unique_lock<PlayerMutex> &fileLock){
+    {
+        std::lock_guard<PlayerMutex> lock(MUTEX_SITE(compression_lock));
+        if(!freeBlocks.empty()){
+            compressionQueue.push(std::move(pendingBlock));
+            pendingBlock = std::move(freeBlocks.back()); // keeps its capacity, so the next logs don't allocate
+            freeBlocks.pop_back();
+            pendingBlock.clear();
+            blockReady.notify_one();
+            return true;
         }
+    }
+
+    // all the blocks are queued, so logging waits for the compression (file is unlocked for the compression thread).
+    fileLock.unlock();
+    {
+        std::unique_lock<PlayerMutex> lock(MUTEX_SITE(compression_lock));
+        blockWritten.wait(lock, [this](){ return !freeBlocks.empty(); });
+    }
+    fileLock.lock();
+    return false;
+}
 
-        // ---------- write logs into file if enabled ----------
-        if(fileOutput){
-            lock_guard<mutex> lock(file_lock);
-            fprintf(file, logMessage.str().c_str());
+void Logger::flushCompressedBlocks(){
+    {
+        std::unique_lock<PlayerMutex> lock(MUTEX_SITE(file_lock));
+        while(!pendingBlock.empty() && !queuePendingBlock(lock)){}
+    }
+    std::unique_lock<PlayerMutex> lock(MUTEX_SITE(compression_lock));
+    blockWritten.wait(lock, [this](){ return compressionQueue.empty() && !compressing; });
+}
+
+/* length of the "[time] [thread] [priority] [line] " header of the log line, 0 if it is not found. */
+static size_t headerLength(const char *line, const size_t length)
+{
+    const char *position = line;
+    for(int fields=0; fields<4; fields++){
+        const char *end = static_cast<const char*>(memmem(position, length - (position - line), "] ", 2));
+        if(end == NULL)
+            return 0;
+        position = end + 2;
+    }
+    return position - line;
+}
+
+void Logger::appendToBlock(std::unique_lock<PlayerMutex> &fileLock, const char *line, const size_t length){
+    // a line longer than a block is split into lines with its header, so every piece is in a single block and can be filtered.
+    size_t header = (length > COMPRESSION_BLOCK_SIZE) ? headerLength(line, length) : 0;
+    size_t position = 0;
+    while(position < length)
+    {
+        size_t prefix = (position > 0) ? header : 0;
+        size_t pieceLength = std::min(length - position, COMPRESSION_BLOCK_SIZE - prefix);
+        bool last = position + pieceLength == length;
+        if(!last)
+            pieceLength--; // for the '\n' of the piece
+        size_t blockLength = prefix + pieceLength + (last ? 0 : 1);
+
+        while(pendingBlock.size() + blockLength > COMPRESSION_BLOCK_SIZE){
+            queuePendingBlock(fileLock);
+            if(!fileCompression){ // disabled while waiting for a free block, so the rest is written like the next logs
+                if(openFile() != NULL)
+                    fwrite(line + position, 1, length - position, file);
+                return;
+            }
         }
+        pendingBlock.append(line, prefix);
+        pendingBlock.append(line + position, pieceLength);
+        if(!last)
+            pendingBlock.push_back('\n');
+        position += pieceLength;
+    }
+    if(pendingBlock.size() >= COMPRESSION_BLOCK_SIZE)
+        while(!pendingBlock.empty() && !queuePendingBlock(fileLock)){}
+}
+
+void Logger::compressBlocks(){
+    std::vector<char> encoded;
+    std::unique_lock<PlayerMutex> lock(MUTEX_SITE(compression_lock));
+    while(true)
+    {
+        blockReady.wait(lock, [this](){ return !compressionQueue.empty() || stopCompression; });
+        if(compressionQueue.empty()) // stopped, and all the blocks are written
+            break;
+
+        std::string block = std::move(compressionQueue.front());
+        compressionQueue.pop();
+        compressing = true;
+        lock.unlock();
+
+        // compression is done without any lock, so logging threads are not blocked.
+        encoded.clear();
+        LogCodec::encodeBlock(block.data(), block.size(), encoded);
+        {
+            std::lock_guard<PlayerMutex> fileLock(MUTEX_SITE(file_lock));
+            if(openFile() != NULL){
+                fwrite(encoded.data(), 1, encoded.size(), file);
+                fflush(file); // block is complete, so readers can decompress it
+            }
+        }
+
+        lock.lock();
+        freeBlocks.push_back(std::move(block));
+        compressing = false;
+        blockWritten.notify_all();
+    }
+}
+
+void Logger::log(const LogPriority &logPriority, const std::thread::id &threadId, const unsigned short _line_number_, const char* _function_name_, const std::string &message)
+{
+    // Either consoleOutput or fileOutput must be true.
+    // And log priority also should be equal and greater than Logger's priority.
+    if((consoleOutput || fileOutput) && (logPriority >= this->priority))
+        write(logPriority, threadId, _line_number_, _function_name_, message.c_str(), message.size());
+}
+
+void Logger::log(const LogPriority &logPriority, const std::thread::id &threadId, const unsigned short _line_number_, const char* _function_name_, const char* message)
+{
+    if((consoleOutput || fileOutput) && (logPriority >= this->priority))
+        write(logPriority, threadId, _line_number_, _function_name_, message, strlen(message));
+}
+
+void Logger::logf(const LogPriority &logPriority, const std::thread::id &threadId, const unsigned short _line_number_, const char* _function_name_, const char* format, ...)
+{
+    if((consoleOutput || fileOutput) && (logPriority >= this->priority))
+    {
+        static thread_local char message[1024];
+
+        va_list arguments;
+        va_start(arguments, format);
+        int length = vsnprintf(message, sizeof(message), format, arguments);
+        va_end(arguments);
+
+        if(length < 0) return;
+        if((size_t)length >= sizeof(message)) // message is truncated
+            length = sizeof(message)-1;
+        write(logPriority, threadId, _line_number_, _function_name_, message, length);
+    }
+}
+
+void Logger::write(const LogPriority &logPriority, const std::thread::id &threadId, const unsigned short _line_number_, const char* _function_name_, const char* message, const size_t messageLength)
+{
+    using namespace std;
+
+    const char *logType = "";
+    switch (logPriority) {
+        case trace:   logType="trace"; break;
+        case debug:   logType="debug"; break;
+        case info:    logType="info "; break;
+        case warning: logType="warn "; break;
+        case error:   logType="error"; break;
+        case fatal:   logType="fatal"; break;
+    }
+
+    // ---------- thread id is converted into text only once per thread ----------
+    static thread_local thread::id cachedThreadId;
+    static thread_local char threadIdText[32] = "";
+    if(threadIdText[0] == '\0' || cachedThreadId != threadId){
+        ostringstream idStream;
+        idStream << threadId;
+        snprintf(threadIdText, sizeof(threadIdText), "%s", idStream.str().c_str());
+        cachedThreadId = threadId;
+    }
+
+    // ---------- getting current date and time with milliseconds and microseconds ----------
+    using namespace chrono;
+    system_clock::time_point now = clock.load()->now();
+    time_t currentTime = system_clock::to_time_t(now);
+    tm timeStamp;
+    localtime_r(&currentTime, &timeStamp);
+    long long us = duration_cast<microseconds>(now.time_since_epoch()).count();
+    unsigned long int milliseconds = us%1000000/1000;
+    unsigned long int microseconds = us%1000;
+
+    // ---------- make a complete log message ----------
+    static thread_local char buffer[2048];
+    const char *format = "[%04d-%02d-%02d %02d:%02d:%02d.%03lu.%03lu] [%s] [%s] [%4u] %.*s -> [%s] \n";
+    int length = snprintf(buffer, sizeof(buffer), format,
+                          timeStamp.tm_year+1900, timeStamp.tm_mon+1, timeStamp.tm_mday,
+                          timeStamp.tm_hour, timeStamp.tm_min, timeStamp.tm_sec, milliseconds, microseconds,
+                          threadIdText, logType, _line_number_, (int)messageLength, message, _function_name_);
+    if(length < 0) return;
+
+    const char *logMessage = buffer;
+    string longMessage; // used only if the log line does not fit into the buffer
+    if((size_t)length >= sizeof(buffer)){
+        longMessage.resize(length+1);
+        snprintf(longMessage.data(), longMessage.size(), format,
+                 timeStamp.tm_year+1900, timeStamp.tm_mon+1, timeStamp.tm_mday,
+                 timeStamp.tm_hour, timeStamp.tm_min, timeStamp.tm_sec, milliseconds, microseconds,
+                 threadIdText, logType, _line_number_, (int)messageLength, message, _function_name_);
+        logMessage = longMessage.c_str();
+    }
+
+    // ---------- display the log message ----------
+    if(consoleOutput){
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(display_lock));
+        cout.write(logMessage, length).flush();
+    }
+
+    // ---------- write logs into file if enabled ----------
+    if(fileOutput){
+        unique_lock<PlayerMutex> lock(MUTEX_SITE(file_lock));
+        if(fileCompression)
+            appendToBlock(lock, logMessage, length);
+        else if(openFile() != NULL)
+            fwrite(logMessage, 1, length, file);
     }
 }
@@ -5,6 +5,11 @@
 #include <fstream>  // for file output
 #include <mutex>    // to avoid race conditions in output.
 #include <thread>   // to use std::thread::id
+#include <atomic>   // for clock pointer shared between threads
+#include <vector>
+#include "profiledmutex.h"
+#include "playerclock.h"
+#include "ringqueue.h" // for blocks waiting to be compressed
 
 
 /***************************************************************************************************************//**
@@ -25,6 +30,24 @@
 #define LOG(priority, message) (Logger::get()-> Logger::log(priority, std::this_thread::get_id(), __LINE__, __PRETTY_FUNCTION__, message))
 
 
+/***************************************************************************************************************//**
+  * @def LOGF(priority, format, ...)
+  * @brief It is the printf style version of `LOG()`, and is a short hand of the `Logger::logf()`.
+  * @param priority is the `LogPriority` of the log.
+  * @param format is the printf style format of the log message, followed by its arguments.
+  *
+  * Message is formatted into a thread local buffer, instead of building a `std::string`,
+  * so it is used on the hot path (i.e. while playing songs) to log without allocating memory.\n
+  * Arguments are formatted only if the log passes the priority filter.
+  *
+  * **Examples**\n
+  * 1. LOGF(debug, "Song Playing id: %u", song.getId());
+  * 2. LOGF(debug, "name: %.*s", (int)song.getName().size(), song.getName().data());
+  * 3. LOGF(info, "Playlist finished");
+  *****************************************************************************************************************/
+#define LOGF(priority, format, ...) (Logger::get()-> Logger::logf(priority, std::this_thread::get_id(), __LINE__, __PRETTY_FUNCTION__, format __VA_OPT__(,) __VA_ARGS__))
+
+
 /*****************************************************************//**
  * @enum LogPriority
  * @brief The LogPriority enum defines the priority of different logs.
@@ -109,6 +132,39 @@ public:
      ***********************************************************************/
     void setFilename(const char *filename);
 
+    /*************************************************************************************************//**
+     * @brief enables the compressed file output of logs.
+     * @param filename sets the log file name if provided (default `NULL` means `<current log file>.lz`).
+     *
+     * Logs are collected into blocks of `COMPRESSION_BLOCK_SIZE` bytes,
+     * and a background thread compresses the blocks with [LogCodec](@ref LogCodec) and writes them into the file.\n
+     * `COMPRESSION_BLOCKS` blocks are allocated once and recycled, so logging waits for the compression only
+     * if all of them are queued (i.e. the disk can not keep up), instead of allocating more.\n
+     * A line longer than a block is split into lines of the same header, so that every block can be read alone.\n
+     * Compressed file can not be mixed with text logs, so if the file already contains text logs,
+     * an error is logged and the compression is not enabled.
+     * [LogReader](@ref LogReader) and `logquery` can read the compressed file directly.
+     ****************************************************************************************************/
+    void enableFileCompression(const char *filename = NULL);
+
+    /*******************************************************************//**
+     * @brief disables the compression, after writing the pending logs.
+     * Logs will be written into the file as text.
+     **********************************************************************/
+    void disableFileCompression();
+
+    /*******************************************************************//**
+     * @brief used to know whether the file compression is enabled or not.
+     * @return value of `bool fileCompression` member.
+     **********************************************************************/
+    bool isFileCompressionEnabled() const;
+
+    /** @brief size of the uncompressed block, after which the block is sent for compression. */
+    static const size_t COMPRESSION_BLOCK_SIZE = 256*1024;
+
+    /** @brief number of the blocks of the compressed output, including the block being filled and the block being compressed. */
+    static const size_t COMPRESSION_BLOCKS = 8;
+
     /**********************************************************//**
      * @brief is used to set log priority, to filter logs.
      * @param priority is the new `LogPriority`to set.
@@ -124,6 +180,15 @@ public:
      *****************************************/
     LogPriority getPriority() const;
 
+    /**********************************************************************************//**
+     * @brief is used to change the clock from which the timestamps of the logs are taken.
+     * @param clock is the new clock, `NULL` sets the real time clock back (default).
+     *
+     * It is used with the [VirtualClock](@ref VirtualClock), so that the fast-forwarded
+     * playback is logged with its virtual timestamps.
+     *************************************************************************************/
+    void setClock(PlayerClock *clock);
+
     /*****************************************************************************************************************//**
      * @brief displays and/or saves(into file) logs with timestamp, thread-id, line-number and function-name.
      * @param logPriority is the priority of the log message.
@@ -156,8 +221,66 @@ public:
              const char* _function_name_,
              const std::string &message);
 
+    /*****************************************************************************************************************//**
+     * @brief overload of `log()` for string literals, so that `LOG(trace, "message")` doesn't build a `std::string`.
+     *********************************************************************************************************************/
+    void log(const LogPriority &logPriority,
+             const std::thread::id &threadId,
+             const unsigned short _line_number_,
+             const char* _function_name_,
+             const char* message);
+
+    /*****************************************************************************************************************//**
+     * @brief printf style version of `log()`, which formats the message without allocating memory.
+     * @param logPriority is the priority of the log message.
+     * @param threadId is id of the thread who called this function (generally taken care by macro `LOGF`).
+     * @param _line_number_ is the number of line on which the `logf()` is called.
+     * @param _function_name_ is the name of the function in which the `logf()` is called.
+     * @param format is the printf style format of the log message, followed by its arguments.
+     *
+     * Better to use macro `LOGF()` instead of this function.
+     *********************************************************************************************************************/
+    void logf(const LogPriority &logPriority,
+              const std::thread::id &threadId,
+              const unsigned short _line_number_,
+              const char* _function_name_,
+              const char* format, ...) __attribute__((format(printf, 6, 7)));
+
 private:
 
+    /*******************************************************************************************************//**
+     * @brief write formats the complete log line and displays and/or writes it into the file.
+     *
+     * The line is formatted into a thread local buffer,
+     * so logging a message doesn't allocate memory unless the line is longer than the buffer.\n
+     * It is used by both `log()` and `logf()`, after checking the priority.
+     **********************************************************************************************************/
+    void write(const LogPriority &logPriority,
+               const std::thread::id &threadId,
+               const unsigned short _line_number_,
+               const char* _function_name_,
+               const char* message,
+               const size_t messageLength);
+
+    /*****************************************************************************************************//**
+     * @brief queues the `pendingBlock` for compression, and takes a free block for the next logs.
+     * @param fileLock is the caller's lock of `file_lock`, it is released while waiting for a free block.
+     * @return false if it waited, then the caller must check `pendingBlock` again, since other threads may have logged.
+     ********************************************************************************************************/
+    bool queuePendingBlock(std::unique_lock<PlayerMutex> &fileLock);
+
+    /** @brief appends the line to the `pendingBlock`, splitting it if it is longer than a block. */
+    void appendToBlock(std::unique_lock<PlayerMutex> &fileLock, const char *line, const size_t length);
+
+    /** @brief opens the log file on its first log, so a file which is never written is not created, `file_lock` must be locked. */
+    FILE* openFile();
+
+    /** @brief queues the pending logs and waits until all the queued blocks are written into the file. */
+    void flushCompressedBlocks();
+
+    /** @brief compressBlocks is the body of the `compressionThread`. */
+    void compressBlocks();
+
     /***********************************************************************//**
      * @brief `Logger()` is a private default constructor.
      *
@@ -190,17 +313,50 @@ private:
     /** @brief filename stores the name of the file to write logs into (default `logs.log`). */
     char *filename;
 
-    /** @brief file is used to write logs into log file. */
+    /** @brief file is used to write logs into log file, `NULL` until the first log is written. */
     FILE *file;
 
+    /** @brief fileOpenFailed is true if the log file can not be opened, so it is not opened again for every log. */
+    bool fileOpenFailed;
+
+    /** @brief used to determine whether to compress the logs written into file or not (default `false`). */
+    bool fileCompression;
+
+    /** @brief pendingBlock collects the logs until the block is full (guarded by `file_lock`). */
+    std::string pendingBlock;
+
+    /** @brief compressionQueue contains the full blocks waiting to be compressed and written. */
+    RingQueue<std::string> compressionQueue;
+
+    /** @brief freeBlocks are the buffers of written blocks, reused for the next blocks (`COMPRESSION_BLOCKS` in total). */
+    std::vector<std::string> freeBlocks;
+
+    /** @brief compressing is true while the compression thread is compressing or writing a block. */
+    bool compressing;
+
+    /** @brief stopCompression asks the compression thread to stop, after writing all the queued blocks. */
+    bool stopCompression;
+
+    /** @brief compressionThread compresses the queued blocks and writes them into the file. */
+    std::thread compressionThread;
+
+    /** @brief compression_lock protects `compressionQueue`, `freeBlocks`, `compressing` and `stopCompression`. */
+    PlayerMutex compression_lock;
+
+    /** @brief blockReady wakes the compression thread when a block is queued. */
+    PlayerConditionVariable blockReady;
+
+    /** @brief blockWritten wakes the threads waiting for the queued blocks to be written, or for a free block. */
+    PlayerConditionVariable blockWritten;
+
     /** @brief display_lock used to prevent race condition while displaying logs into console. */
-    std::mutex display_lock;
+    PlayerMutex display_lock;
 
     /** @brief file_lock mutex is used to prevent the race condition to write logs into `file`. */
-    std::mutex file_lock;
+    PlayerMutex file_lock;
 
     /** @brief get_instance_lock is used to make `Logger::get()` thread safe, to prevent creation of more than one objects. */
-    static std::mutex get_instance_lock;
+    static PlayerMutex get_instance_lock;
 
     /** @brief logger is a pointer to the singleton object of the class. */
     static Logger *logger;
@@ -215,11 +371,8 @@ private:
      ************************************************************************************************************/
     LogPriority priority;
 
-    /** @brief it is used to get the current system time to display log time(used by `tm *timeStamp`). */
-    time_t currentTime;
-
-    /** @brief it is used to hold the localtime of the system to display log's timestamp. */
-    tm *timeStamp;
+    /** @brief clock is used to get the timestamp of the logs (default `PlayerClock::realTime()`). */
+    std::atomic<PlayerClock*> clock;
 };
 
 #endif // LOGGER_H
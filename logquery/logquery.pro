@@ -0,0 +1,15 @@
+TEMPLATE = app
+CONFIG += console c++20
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        ../logcodec.cpp \
+        ../logreader.cpp \
+        main.cpp
+
+HEADERS += \
+    ../logcodec.h \
+    ../logreader.h
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <fstream>
+#include "logreader.h"
+#include "logcodec.h"
+
+using namespace std;
+
+/*****************************************************************************************************//**
+ * @brief usage displays the command line options of the logquery tool.
+ * @param program is the name of the executable.
+ ********************************************************************************************************/
+int decompressFile(const char *filename)
+{
+    ifstream file(filename, ios::binary);
+    vector<char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if(!file.good() && !file.eof()){
+        cerr << "ERROR: Failed to read log file '" << filename << "'" << endl;
+        return 1;
+    }
+    if(!LogCodec::isCompressed(data.data(), data.size())){
+        cerr << "ERROR: Log file '" << filename << "' is not compressed" << endl;
+        return 1;
+    }
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    vector<char> text;
+    if(!LogCodec::decompressAll(data.data(), data.size(), text)){
+        cerr << "ERROR: Compressed log file '" << filename << "' is corrupted" << endl;
+        return 1;
+    }
+    double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+    fwrite(text.data(), 1, text.size(), stdout);
+    fprintf(stderr, "%zu bytes decompressed from %zu bytes (%.3f ms)\n", text.size(), data.size(), milliseconds);
+    return 0;
+}
+
+void usage(const char *program);
+
+/*****************************************************************************************************//**
+ * @brief decompressFile writes the whole uncompressed log to the standard output.
+ *
+ * It reads the compressed log at once, and decompresses its blocks in parallel on all the cores,
+ * see LogCodec::decompressAll(). Queries never do it, they decompress only the blocks they scan.
+ * @param filename is the name of the compressed log file.
+ * @return 0 on successfull execution, else returns 1.
+ ********************************************************************************************************/
+int decompressFile(const char *filename);
+
+/*****************************************************************************************************//**
+ * @brief main method of the logquery tool, which searches the log files written by the [Logger](@ref Logger).
+ *
+ * **Example**\n
+ * logquery --thread 140613438010304 --priority error --from "2023-04-14 13:00:00" --to "2023-04-14 14:00:00" logs.log
+ *
+ * Matching lines are written to the standard output,
+ * and the number of matches and scanned blocks are written to the standard error.\n
+ * With `--decompress`, the whole compressed log is written to the standard output instead, see decompressFile().
+ * @return 0 on successfull execution, else returns 1.
+ ********************************************************************************************************/
+int main(int argc, char *argv[])
+{
+    LogQuery filter;
+    const char *filename = NULL;
+    bool rebuild = false, countOnly = false, decompress = false;
+
+    for(int i=1; i<argc; i++)
+    {
+        bool hasValue = i+1 < argc;
+        if(strcmp(argv[i], "--thread") == 0 && hasValue){
+            filter.filterThread = true;
+            filter.threadId = strtoull(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--priority") == 0 && hasValue){
+            // comma separated list of priorities, i.e. "warn,error,fatal"
+            filter.priorities = 0;
+            char *priorities = argv[++i];
+            for(char *name = strtok(priorities, ","); name != NULL; name = strtok(NULL, ",")){
+                int priority = LogReader::parsePriority(name);
+                if(priority < 0){
+                    cerr << "Invalid priority '" << name << "'" << endl;
+                    return 1;
+                }
+                filter.priorities |= 1 << priority;
+            }
+        }
+        else if((strcmp(argv[i], "--from") == 0 || strcmp(argv[i], "--to") == 0) && hasValue){
+            bool from = strcmp(argv[i], "--from") == 0;
+            const char *text = argv[++i];
+            long long timestamp = LogReader::parseTimestamp(text, strlen(text));
+            if(timestamp < 0){
+                cerr << "Invalid timestamp '" << text << "', expected 'YYYY-MM-DD HH:MM:SS[.mmm[.uuu]]'" << endl;
+                return 1;
+            }
+            (from ? filter.from : filter.to) = timestamp;
+        }
+        else if(strcmp(argv[i], "--rebuild") == 0)
+            rebuild = true;
+        else if(strcmp(argv[i], "--count") == 0)
+            countOnly = true;
+        else if(strcmp(argv[i], "--decompress") == 0)
+            decompress = true;
+        else if(argv[i][0] != '-' && filename == NULL)
+            filename = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(filename == NULL){
+        usage(argv[0]);
+        return 1;
+    }
+    if(decompress)
+        return decompressFile(filename);
+
+    try {
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        LogReader reader(filename, rebuild);
+        chrono::steady_clock::time_point indexed = chrono::steady_clock::now();
+
+        size_t matches = reader.query(filter, [countOnly](string_view line){
+            if(!countOnly)
+                fwrite(line.data(), 1, line.size(), stdout);
+        });
+        chrono::steady_clock::time_point queried = chrono::steady_clock::now();
+
+        using chrono::duration;
+        fprintf(stderr, "%zu lines matched, %zu of %zu blocks scanned (index %.3f ms, query %.3f ms)\n",
+                matches, reader.scannedBlocks(), reader.totalBlocks(),
+                duration<double, milli>(indexed - begin).count(), duration<double, milli>(queried - indexed).count());
+    }
+    catch (const exception &e) {
+        cerr << "ERROR: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+void usage(const char *program)
+{
+    cerr << "Usage: " << program << " [options] <log file>\n"
+         << "  --thread <id>        lines logged by the thread\n"
+         << "  --priority <list>    comma separated priorities, i.e. warn,error\n"
+         << "  --from <timestamp>   lines at or after 'YYYY-MM-DD HH:MM:SS[.mmm[.uuu]]'\n"
+         << "  --to <timestamp>     lines at or before the timestamp\n"
+         << "  --count              display only the number of matching lines\n"
+         << "  --decompress         write the whole compressed log, decompressed in parallel\n"
+         << "  --rebuild            build the index (<log file>.idx) again" << endl;
+}
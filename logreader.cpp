@@ -0,0 +1,463 @@
+#include "logreader.h"
+#include "logcodec.h"
+#include <cstring>    // for memchr(), memcmp()
+#include <cstdio>
+#include <climits>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>    // for open()
+#include <unistd.h>   // for close()
+#include <sys/mman.h> // for mmap()
+#include <sys/stat.h> // for fstat()
+
+using namespace std;
+
+/* magic string at the beginning of the index file, change the version if the format changes. */
+static const char INDEX_MAGIC[8] = {'L','O','G','I','D','X','0','3'};
+
+/* number of bytes hashed at the beginning and at the end of the indexed part, to recognize the log file. */
+static const size_t FINGERPRINT_SIZE = 4096;
+
+LogQuery::LogQuery()
+{
+    from = LLONG_MIN;
+    to = LLONG_MAX;
+    priorities = 0xFF;
+    filterThread = false;
+    threadId = 0;
+}
+
+
+/* ========== CONSTRUCTOR - DESTRUCTOR ===========*/
+LogReader::LogReader(const string &filename, const bool rebuild)
+{
+    this->filename = filename;
+    this->indexFilename = filename + ".idx";
+    this->data = NULL;
+    this->size = 0;
+    this->mapped = false;
+    this->compressed = false;
+    this->chunkOffset = ULLONG_MAX;
+    this->indexedSize = 0;
+    this->lastScannedBlocks = 0;
+    this->fileDevice = 0;
+    this->fileInode = 0;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw runtime_error("Failed to open log file '" + filename + "'");
+
+    struct stat status;
+    if(fstat(fd, &status) != 0){
+        close(fd);
+        throw runtime_error("Failed to read size of log file '" + filename + "'");
+    }
+    size = status.st_size;
+    fileDevice = status.st_dev;
+    fileInode = status.st_ino;
+    if(size > 0){
+        void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED){
+            close(fd);
+            throw runtime_error("Failed to map log file '" + filename + "'");
+        }
+        data = static_cast<const char*>(mapped);
+        this->mapped = true;
+    }
+    close(fd); // mapping remains valid after closing the file
+
+    compressed = LogCodec::isCompressed(data, size);
+
+    if(rebuild || !loadIndex()){
+        blocks.clear();
+        threads.clear();
+        threadIndex.clear();
+        indexedSize = 0;
+    }
+
+    if(indexedSize < size){
+        // last block of a text log may be incomplete, so index it again along with the new lines.
+        if(!compressed && !blocks.empty()){
+            indexedSize = blocks.back().offset;
+            blocks.pop_back();
+        }
+        if(mapped){
+            size_t pageBegin = indexedSize & ~(static_cast<size_t>(sysconf(_SC_PAGESIZE)) - 1);
+            madvise(const_cast<char*>(data) + pageBegin, size - pageBegin, MADV_SEQUENTIAL);
+        }
+        buildIndex();
+        saveIndex();
+    }
+    prepareSearch();
+    if(mapped)
+        madvise(const_cast<char*>(data), size, MADV_RANDOM);
+}
+
+LogReader::~LogReader(){
+    if(mapped)
+        munmap(const_cast<char*>(data), size);
+}
+
+
+/* ============= PARSING ==============*/
+/* reads `count` digits, returns -1 if any of them is not a digit. */
+static long long readDigits(const char *text, const int count)
+{
+    long long value = 0;
+    for(int i=0; i<count; i++){
+        if(text[i] < '0' || text[i] > '9') return -1;
+        value = value*10 + (text[i]-'0');
+    }
+    return value;
+}
+
+/* number of days since 1970-01-01 of the civil date (proleptic Gregorian calendar). */
+static long long daysFromCivil(long long year, const long long month, const long long day)
+{
+    year -= month <= 2;
+    const long long era = (year >= 0 ? year : year-399) / 400;
+    const long long yearOfEra = year - era*400;
+    const long long dayOfYear = (153*(month + (month > 2 ? -3 : 9)) + 2)/5 + day-1;
+    const long long dayOfEra = yearOfEra*365 + yearOfEra/4 - yearOfEra/100 + dayOfYear;
+    return era*146097 + dayOfEra - 719468;
+}
+
+long long LogReader::parseTimestamp(const char *text, const size_t length)
+{
+    // YYYY-MM-DD HH:MM:SS[.mmm[.uuu]]
+    if(length < 19 || text[4] != '-' || text[7] != '-' || text[10] != ' ' || text[13] != ':' || text[16] != ':')
+        return -1;
+
+    long long year = readDigits(text, 4), month = readDigits(text+5, 2), day = readDigits(text+8, 2);
+    long long hour = readDigits(text+11, 2), minute = readDigits(text+14, 2), second = readDigits(text+17, 2);
+    if(year < 0 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || minute < 0 || second < 0)
+        return -1;
+
+    long long milliseconds = 0, microseconds = 0;
+    if(length >= 23 && text[19] == '.'){
+        milliseconds = readDigits(text+20, 3);
+        if(milliseconds < 0) return -1;
+        if(length >= 27 && text[23] == '.'){
+            microseconds = readDigits(text+24, 3);
+            if(microseconds < 0) return -1;
+        }
+    }
+
+    long long seconds = daysFromCivil(year, month, day)*86400 + hour*3600 + minute*60 + second;
+    return seconds*1000000 + milliseconds*1000 + microseconds;
+}
+
+int LogReader::parsePriority(string_view text)
+{
+    while(!text.empty() && text.back() == ' ')
+        text.remove_suffix(1);
+
+    if(text == "trace") return trace;
+    if(text == "debug") return debug;
+    if(text == "info")  return info;
+    if(text == "warn" || text == "warning") return warning;
+    if(text == "error") return error;
+    if(text == "fatal") return fatal;
+    return -1;
+}
+
+bool LogReader::parseLine(const char *line, const size_t length, LineHeader &header)
+{
+    // [2023-04-14 13:17:05.041.354] [140613438010304] [trace] [  31] message -> [function]
+    static const size_t TIMESTAMP_LENGTH = 29;
+    if(length < TIMESTAMP_LENGTH+4 || line[0] != '[' || line[TIMESTAMP_LENGTH-1] != ']')
+        return false;
+
+    header.time = parseTimestamp(line+1, TIMESTAMP_LENGTH-2);
+    if(header.time < 0 || line[TIMESTAMP_LENGTH] != ' ' || line[TIMESTAMP_LENGTH+1] != '[')
+        return false;
+
+    const char *threadBegin = line + TIMESTAMP_LENGTH+2;
+    const char *end = line + length;
+    const char *threadEnd = static_cast<const char*>(memchr(threadBegin, ']', end - threadBegin));
+    if(threadEnd == NULL)
+        return false;
+
+    // thread ids are numbers on linux, any other text is hashed into a number.
+    header.threadId = 0;
+    for(const char *digit = threadBegin; digit < threadEnd; digit++){
+        if(*digit < '0' || *digit > '9'){
+            header.threadId = hash<string_view>()(string_view(threadBegin, threadEnd - threadBegin));
+            break;
+        }
+        header.threadId = header.threadId*10 + (*digit-'0');
+    }
+
+    // " [trace]"
+    if(end - threadEnd < 9 || threadEnd[1] != ' ' || threadEnd[2] != '[' || threadEnd[8] != ']')
+        return false;
+    header.priority = parsePriority(string_view(threadEnd+3, 5));
+    return header.priority >= 0;
+}
+
+
+/* ============= INDEX ==============*/
+unsigned long long LogReader::threadBit(const unsigned long long threadId) const
+{
+    auto found = threadIndex.find(threadId);
+    if(found == threadIndex.end())
+        return 0;
+    return 1ULL << min<size_t>(found->second, 63);
+}
+
+unsigned long long LogReader::addThread(const unsigned long long threadId)
+{
+    auto found = threadIndex.find(threadId);
+    if(found == threadIndex.end()){
+        found = threadIndex.emplace(threadId, threads.size()).first;
+        threads.push_back(threadId);
+    }
+    return 1ULL << min<size_t>(found->second, 63);
+}
+
+void LogReader::buildIndex()
+{
+    if(!compressed){
+        indexedSize += indexLines(data + indexedSize, size - indexedSize, indexedSize, false);
+        return;
+    }
+
+    // compressed blocks are decompressed one by one, so the whole log never has to fit into memory.
+    while(size - indexedSize >= LogCodec::HEADER_SIZE)
+    {
+        LogCodec::BlockHeader header;
+        if(!LogCodec::readHeader(data + indexedSize, header))
+            throw runtime_error("Compressed log file '" + filename + "' is corrupted");
+        size_t payloadSize = header.storedSize & ~LogCodec::RAW_FLAG;
+        if(size - indexedSize - LogCodec::HEADER_SIZE < payloadSize) // incomplete last block, the logger is still writing it.
+            break;
+
+        const vector<char> &text = loadChunk(indexedSize);
+        indexLines(text.data(), text.size(), indexedSize, true);
+        indexedSize += LogCodec::HEADER_SIZE + payloadSize;
+    }
+}
+
+size_t LogReader::indexLines(const char *text, const size_t length, const unsigned long long offset, const bool inChunk)
+{
+    // blocks of a compressed log are located by (offset of the compressed block, offset in its uncompressed data).
+    auto newBlock = [&](size_t position) -> Block {
+        return {inChunk ? offset : offset + position, static_cast<unsigned int>(inChunk ? position : 0), 0,
+                LLONG_MAX, LLONG_MIN, 0, 0};
+    };
+    size_t position = 0, blockBegin = 0;
+    Block block = newBlock(0);
+
+    while(position < length)
+    {
+        const char *lineEnd = static_cast<const char*>(memchr(text + position, '\n', length - position));
+        if(lineEnd == NULL && !inChunk) // incomplete last line, the logger is still writing it.
+            break;
+        size_t lineLength = (lineEnd != NULL) ? lineEnd - (text + position) + 1 : length - position;
+
+        // start a new block at the first line after BLOCK_SIZE bytes.
+        if(position - blockBegin >= BLOCK_SIZE){
+            block.length = position - blockBegin;
+            blocks.push_back(block);
+            blockBegin = position;
+            block = newBlock(position);
+        }
+
+        LineHeader header;
+        if(parseLine(text + position, lineLength, header)){
+            block.minTime = min(block.minTime, header.time);
+            block.maxTime = max(block.maxTime, header.time);
+            block.threadMask |= addThread(header.threadId);
+            block.priorityMask |= 1 << header.priority;
+        }
+        position += lineLength;
+    }
+
+    if(position > blockBegin){
+        block.length = position - blockBegin;
+        blocks.push_back(block);
+    }
+    return position;
+}
+
+const vector<char>& LogReader::loadChunk(const unsigned long long offset) const
+{
+    if(chunkOffset == offset)
+        return chunk;
+
+    LogCodec::BlockHeader header;
+    bool valid = offset + LogCodec::HEADER_SIZE <= size && LogCodec::readHeader(data + offset, header);
+    size_t payloadSize = valid ? header.storedSize & ~LogCodec::RAW_FLAG : 0;
+    valid = valid && offset + LogCodec::HEADER_SIZE + payloadSize <= size;
+    if(valid){
+        const char *payload = data + offset + LogCodec::HEADER_SIZE;
+        chunk.resize(header.rawSize);
+        if(header.storedSize & LogCodec::RAW_FLAG)
+            memcpy(chunk.data(), payload, header.rawSize);
+        else
+            valid = LogCodec::decompress(payload, payloadSize, chunk.data(), header.rawSize);
+        valid = valid && LogCodec::checksum(chunk.data(), chunk.size()) == header.checksum;
+    }
+    if(!valid){
+        chunkOffset = ULLONG_MAX;
+        throw runtime_error("Compressed log file '" + filename + "' is corrupted");
+    }
+    chunkOffset = offset;
+    return chunk;
+}
+
+void LogReader::prepareSearch()
+{
+    runningMaxTime.resize(blocks.size());
+    suffixMinTime.resize(blocks.size());
+
+    long long maxTime = LLONG_MIN;
+    for(size_t i=0; i<blocks.size(); i++){
+        maxTime = max(maxTime, blocks[i].maxTime);
+        runningMaxTime[i] = maxTime;
+    }
+    long long minTime = LLONG_MAX;
+    for(size_t i=blocks.size(); i-- > 0;){
+        minTime = min(minTime, blocks[i].minTime);
+        suffixMinTime[i] = minTime;
+    }
+}
+
+unsigned long long LogReader::fingerprint(const size_t length) const
+{
+    // first bytes identify the file (they contain the timestamp of the first log),
+    // last bytes before `length` detect a file which is rewritten up to the same size.
+    size_t head = min(length, FINGERPRINT_SIZE), tail = min(length, FINGERPRINT_SIZE);
+    return (static_cast<unsigned long long>(LogCodec::checksum(data, head)) << 32)
+         | LogCodec::checksum(data + length - tail, tail);
+}
+
+bool LogReader::loadIndex()
+{
+    FILE *file = fopen(indexFilename.c_str(), "rb");
+    if(file == NULL)
+        return false;
+
+    char magic[sizeof(INDEX_MAGIC)];
+    unsigned long long savedSize = 0, totalThreads = 0, totalBlocks = 0;
+    unsigned long long savedDevice = 0, savedInode = 0, savedFingerprint = 0;
+    bool valid = fread(magic, sizeof(magic), 1, file) == 1
+              && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0
+              && fread(&savedSize, sizeof(savedSize), 1, file) == 1
+              && savedSize <= size  // log file is truncated or replaced
+              && fread(&savedDevice, sizeof(savedDevice), 1, file) == 1
+              && fread(&savedInode, sizeof(savedInode), 1, file) == 1
+              && fread(&savedFingerprint, sizeof(savedFingerprint), 1, file) == 1
+              && savedDevice == fileDevice && savedInode == fileInode   // log file is rotated
+              && savedFingerprint == fingerprint(savedSize)             // log file is rewritten
+              && fread(&totalThreads, sizeof(totalThreads), 1, file) == 1;
+
+    if(valid){
+        threads.resize(totalThreads);
+        valid = fread(threads.data(), sizeof(unsigned long long), totalThreads, file) == totalThreads
+             && fread(&totalBlocks, sizeof(totalBlocks), 1, file) == 1;
+    }
+    for(unsigned long long i=0; valid && i<totalBlocks; i++){
+        Block block;
+        valid = fread(&block.offset, sizeof(block.offset), 1, file) == 1
+             && fread(&block.rawOffset, sizeof(block.rawOffset), 1, file) == 1
+             && fread(&block.length, sizeof(block.length), 1, file) == 1
+             && fread(&block.minTime, sizeof(block.minTime), 1, file) == 1
+             && fread(&block.maxTime, sizeof(block.maxTime), 1, file) == 1
+             && fread(&block.threadMask, sizeof(block.threadMask), 1, file) == 1
+             && fread(&block.priorityMask, sizeof(block.priorityMask), 1, file) == 1;
+        blocks.push_back(block);
+    }
+    fclose(file);
+
+    if(!valid)
+        return false;
+
+    for(size_t i=0; i<threads.size(); i++)
+        threadIndex[threads[i]] = i;
+    indexedSize = savedSize;
+    return true;
+}
+
+void LogReader::saveIndex() const
+{
+    FILE *file = fopen(indexFilename.c_str(), "wb");
+    if(file == NULL) // index is only a cache, queries still work without saving it.
+        return;
+
+    unsigned long long savedSize = indexedSize, totalThreads = threads.size(), totalBlocks = blocks.size();
+    unsigned long long savedFingerprint = fingerprint(indexedSize);
+    fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC), 1, file);
+    fwrite(&savedSize, sizeof(savedSize), 1, file);
+    fwrite(&fileDevice, sizeof(fileDevice), 1, file);
+    fwrite(&fileInode, sizeof(fileInode), 1, file);
+    fwrite(&savedFingerprint, sizeof(savedFingerprint), 1, file);
+    fwrite(&totalThreads, sizeof(totalThreads), 1, file);
+    fwrite(threads.data(), sizeof(unsigned long long), totalThreads, file);
+    fwrite(&totalBlocks, sizeof(totalBlocks), 1, file);
+    for(const Block &block : blocks){
+        fwrite(&block.offset, sizeof(block.offset), 1, file);
+        fwrite(&block.rawOffset, sizeof(block.rawOffset), 1, file);
+        fwrite(&block.length, sizeof(block.length), 1, file);
+        fwrite(&block.minTime, sizeof(block.minTime), 1, file);
+        fwrite(&block.maxTime, sizeof(block.maxTime), 1, file);
+        fwrite(&block.threadMask, sizeof(block.threadMask), 1, file);
+        fwrite(&block.priorityMask, sizeof(block.priorityMask), 1, file);
+    }
+    fclose(file);
+}
+
+
+/* ============= QUERY ==============*/
+size_t LogReader::query(const LogQuery &filter, const function<void(string_view line)> &callback) const
+{
+    lastScannedBlocks = 0;
+
+    unsigned long long threadMask = ~0ULL;
+    if(filter.filterThread){
+        threadMask = threadBit(filter.threadId);
+        if(threadMask == 0) // thread never logged anything
+            return 0;
+    }
+
+    // first block which may contain a line at or after `from`.
+    size_t first = lower_bound(runningMaxTime.begin(), runningMaxTime.end(), filter.from) - runningMaxTime.begin();
+
+    size_t matches = 0;
+    for(size_t i=first; i<blocks.size() && suffixMinTime[i] <= filter.to; i++)
+    {
+        const Block &block = blocks[i];
+        if(block.maxTime < filter.from || block.minTime > filter.to
+           || (block.priorityMask & filter.priorities) == 0 || (block.threadMask & threadMask) == 0)
+            continue;
+
+        lastScannedBlocks++;
+        const char *text = compressed ? loadChunk(block.offset).data() + block.rawOffset : data + block.offset;
+        size_t offset = 0;
+        while(offset < block.length)
+        {
+            const char *lineEnd = static_cast<const char*>(memchr(text + offset, '\n', block.length - offset));
+            size_t lineLength = (lineEnd != NULL) ? lineEnd - (text + offset) + 1 : block.length - offset;
+
+            LineHeader header;
+            if(parseLine(text + offset, lineLength, header)
+               && header.time >= filter.from && header.time <= filter.to
+               && (filter.priorities & (1 << header.priority))
+               && (!filter.filterThread || header.threadId == filter.threadId))
+            {
+                matches++;
+                callback(string_view(text + offset, lineLength));
+            }
+            offset += lineLength;
+        }
+    }
+    return matches;
+}
+
+size_t LogReader::totalBlocks() const{
+    return blocks.size();
+}
+
+size_t LogReader::scannedBlocks() const{
+    return lastScannedBlocks;
+}
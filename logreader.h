@@ -0,0 +1,225 @@
+#ifndef LOGREADER_H
+#define LOGREADER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include "logger.h"  // for LogPriority
+
+
+/*********************************************************************************************//**
+ * @struct LogQuery
+ * @brief LogQuery is the filter of the log lines searched by the [LogReader](@ref LogReader).
+ *
+ * Timestamps are the keys returned by `LogReader::parseTimestamp()`, and both ends are inclusive.\n
+ * By default, query matches all the lines.
+ ************************************************************************************************/
+struct LogQuery
+{
+    LogQuery();
+
+    /** @brief from is the first timestamp to match. */
+    long long from;
+
+    /** @brief to is the last timestamp to match. */
+    long long to;
+
+    /** @brief priorities is the bit mask of `LogPriority` to match, bit `1 << priority`. */
+    unsigned char priorities;
+
+    /** @brief filterThread indicates whether to match only the lines of `threadId` or not. */
+    bool filterThread;
+
+    /** @brief threadId is the thread to match, if `filterThread` is true. */
+    unsigned long long threadId;
+};
+
+
+/*********************************************************************************************************//**
+ * @class LogReader
+ * @brief LogReader searches the log files written by the [Logger](@ref Logger), without reading the whole file.
+ *
+ * Log file is memory mapped, and a sparse index is kept in a sidecar file (`<log file>.idx`).\n
+ * Index divides the log into blocks of `BLOCK_SIZE` bytes (on line boundaries), and for each block it stores
+ * 1. byte offset and length of the block
+ * 2. minimum and maximum timestamp of the block
+ * 3. bit mask of the priorities present in the block
+ * 4. bit mask of the threads present in the block (thread ids are numbered in the index)
+ * .
+ * Queries binary search the first block of the time range, skip the blocks which can not match,
+ * and scan the lines of the remaining blocks with `memchr()` (which is vectorized by the C library).\n
+ * Logs are appended only, so when the log file grows, only the new part is indexed.\n
+ * Index is built again if the log file is rotated or rewritten (see `fingerprint()`).\n
+ * Log files compressed by the [Logger](@ref Logger) (see `Logger::enableFileCompression()`) are indexed
+ * one compressed block at a time, and an index block is located by the file offset of its compressed block
+ * and its offset in the uncompressed data of that block.\n
+ * So a query decompresses only the compressed blocks it scans, and the whole log never has to fit into memory.
+ ************************************************************************************************************/
+class LogReader
+{
+public:
+
+    /** @brief size (in bytes) of the blocks of the index. */
+    static const size_t BLOCK_SIZE = 64*1024;
+
+    /*************************************************************************************//**
+     * @brief LogReader maps the log file, and loads, extends or builds its index.
+     * @param filename is the name of the log file.
+     * @param rebuild forces to build the index again, even if it exists (default `false`).
+     *
+     * It throws `std::runtime_error` if the log file can not be opened.
+     ****************************************************************************************/
+    LogReader(const std::string &filename, const bool rebuild = false);
+
+    /** @brief ~LogReader unmaps the log file. */
+    ~LogReader();
+
+    LogReader(const LogReader &) = delete;
+    LogReader& operator= (const LogReader &) = delete;
+
+    /***************************************************************************************//**
+     * @brief query calls the `callback` for each line (including `\n`) matching the `filter`.
+     * @param filter is the query to match.
+     * @param callback is called for each matching line, in the order of the file.
+     * @return number of the matching lines.
+     ******************************************************************************************/
+    size_t query(const LogQuery &filter, const std::function<void(std::string_view line)> &callback) const;
+
+    /** @brief total number of the blocks in the index. */
+    size_t totalBlocks() const;
+
+    /** @brief number of the blocks scanned by the last query. */
+    size_t scannedBlocks() const;
+
+    /*************************************************************************************************//**
+     * @brief parseTimestamp converts the text `YYYY-MM-DD HH:MM:SS[.mmm[.uuu]]` into a comparable key.
+     * @param text is the timestamp, as it is written in the logs (without brackets).
+     * @param length is the length of the `text`.
+     * @return microseconds since 1970-01-01 of the (local) time written in the text, or -1 if invalid.
+     ****************************************************************************************************/
+    static long long parseTimestamp(const char *text, const size_t length);
+
+    /***********************************************************************//**
+     * @brief parsePriority converts the priority written in the logs into `LogPriority`.
+     * @param text is the priority, i.e. `trace`, `warn` or `error`.
+     * @return the priority, or -1 if invalid.
+     **************************************************************************/
+    static int parsePriority(std::string_view text);
+
+private:
+
+    /** @brief Block is the entry of the sparse index. */
+    struct Block {
+        unsigned long long offset;      // byte offset of the block, or of the compressed block containing it
+        unsigned int rawOffset;         // offset of the block in the uncompressed data, 0 in a text log
+        unsigned int length;            // uncompressed size of the block
+        long long minTime;
+        long long maxTime;
+        unsigned long long threadMask;
+        unsigned char priorityMask;
+    };
+
+    /** @brief LineHeader contains the fields parsed from the beginning of a log line. */
+    struct LineHeader {
+        long long time;
+        unsigned long long threadId;
+        int priority;
+    };
+
+    /** @brief name of the log file. */
+    std::string filename;
+
+    /** @brief name of the sidecar index file. */
+    std::string indexFilename;
+
+    /** @brief data is the memory mapped log file. */
+    const char *data;
+
+    /** @brief size of the `data`. */
+    size_t size;
+
+    /** @brief mapped indicates whether `data` is memory mapped or not (needs to be unmapped). */
+    bool mapped;
+
+    /** @brief compressed indicates whether the log file is written by the compressed file output. */
+    bool compressed;
+
+    /** @brief chunk is the uncompressed data of the last compressed block read. */
+    mutable std::vector<char> chunk;
+
+    /** @brief chunkOffset is the file offset of the compressed block in `chunk`, `ULLONG_MAX` if none. */
+    mutable unsigned long long chunkOffset;
+
+    /** @brief indexedSize is the number of bytes of the log file covered by the index (complete lines or blocks only). */
+    size_t indexedSize;
+
+    /** @brief fileDevice is the device of the log file, saved in the index to detect a rotated log file. */
+    unsigned long long fileDevice;
+
+    /** @brief fileInode is the inode of the log file, saved in the index to detect a rotated log file. */
+    unsigned long long fileInode;
+
+    /** @brief blocks of the sparse index. */
+    std::vector<Block> blocks;
+
+    /** @brief threads contains the thread ids, index of the thread is its bit in `Block::threadMask`. */
+    std::vector<unsigned long long> threads;
+
+    /** @brief threadIndex maps thread id to its index in `threads`. */
+    std::unordered_map<unsigned long long, size_t> threadIndex;
+
+    /** @brief runningMaxTime[i] is the maximum timestamp of blocks [0, i], used for binary search. */
+    std::vector<long long> runningMaxTime;
+
+    /** @brief suffixMinTime[i] is the minimum timestamp of blocks [i, end), used to stop the scan early. */
+    std::vector<long long> suffixMinTime;
+
+    /** @brief number of the blocks scanned by the last query. */
+    mutable size_t lastScannedBlocks;
+
+    /** @brief loads the index file, returns false if it does not exist or does not match the log file. */
+    bool loadIndex();
+
+    /*****************************************************************************************************//**
+     * @brief fingerprint hashes the first and the last `FINGERPRINT_SIZE` bytes of the first `length` bytes.
+     *
+     * It is saved in the index along with the device and inode of the log file, so the index is built again
+     * if the log file is replaced by another one (even a larger one) instead of being appended.
+     ********************************************************************************************************/
+    unsigned long long fingerprint(const size_t length) const;
+
+    /** @brief saves the index into the sidecar file. */
+    void saveIndex() const;
+
+    /** @brief indexes the log file from `indexedSize` up to its last complete line (or compressed block). */
+    void buildIndex();
+
+    /*****************************************************************************************************//**
+     * @brief indexLines appends the index blocks of the lines of the text.
+     * @param text is the part of a text log, or the uncompressed data of a compressed block.
+     * @param length is the number of bytes of the `text`.
+     * @param offset is the file offset of the `text`, or of the compressed block.
+     * @param inChunk is true if the text is the uncompressed data of a compressed block.
+     * @return number of the bytes indexed (an incomplete last line of a text log is not indexed).
+     ********************************************************************************************************/
+    size_t indexLines(const char *text, const size_t length, const unsigned long long offset, const bool inChunk);
+
+    /** @brief returns the uncompressed data of the compressed block at the offset, it throws `std::runtime_error` if it is corrupted. */
+    const std::vector<char>& loadChunk(const unsigned long long offset) const;
+
+    /** @brief computes `runningMaxTime` and `suffixMinTime` of the blocks. */
+    void prepareSearch();
+
+    /** @brief bit of the thread in the `Block::threadMask` (last bit is shared by all the extra threads), 0 if unknown. */
+    unsigned long long threadBit(const unsigned long long threadId) const;
+
+    /** @brief adds the thread into `threads` if it is new, and returns its bit in `Block::threadMask`. */
+    unsigned long long addThread(const unsigned long long threadId);
+
+    /** @brief parses the timestamp, thread id and priority of the line. */
+    static bool parseLine(const char *line, const size_t length, LineHeader &header);
+};
+
+#endif // LOGREADER_H
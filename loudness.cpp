@@ -0,0 +1,510 @@
+#include "loudness.h"
+#include "logger.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+#include <stdexcept>
+#include <fcntl.h>     // for open()
+#include <unistd.h>    // for close()
+#include <sys/mman.h>  // for mmap()
+#include <sys/stat.h>  // for stat()
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+/* magic string at the beginning of the cache file, change the version if the format changes. */
+static const char CACHE_MAGIC[8] = {'L','O','U','D','N','S','0','1'};
+
+constexpr double Loudness::TARGET_LUFS;
+
+/* checks whether the file still has the size and modification time, with which it was analysed. */
+static bool sameFile(const string &filename, const Loudness &loudness)
+{
+    struct stat status;
+    return stat(filename.c_str(), &status) == 0
+        && static_cast<unsigned long long>(status.st_size) == loudness.fileSize
+        && static_cast<long long>(status.st_mtime) == loudness.fileModified;
+}
+
+
+/* ============= LOUDNESS METER ==============*/
+LoudnessMeter::LoudnessMeter(const unsigned int sampleRate, const unsigned int channels)
+{
+    this->channels = channels;
+
+    // K-weighting filters of ITU-R BS.1770, derived for any sample rate (they are specified only for 48 kHz).
+    double K = tan(M_PI * 1681.974450955533 / sampleRate);
+    double Q = 0.7071752369554196;
+    double Vh = pow(10.0, 3.999843853973347 / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K/Q + K*K;
+    shelf = {(Vh + Vb*K/Q + K*K) / a0, 2.0*(K*K - Vh) / a0, (Vh - Vb*K/Q + K*K) / a0,
+             2.0*(K*K - 1.0) / a0, (1.0 - K/Q + K*K) / a0};
+
+    K = tan(M_PI * 38.13547087602444 / sampleRate);
+    Q = 0.5003270373238773;
+    a0 = 1.0 + K/Q + K*K;
+    highPass = {1.0, -2.0, 1.0, 2.0*(K*K - 1.0) / a0, (1.0 - K/Q + K*K) / a0};
+
+    // 5.1 layout (L, R, C, LFE, Ls, Rs): LFE is ignored and the surround channels are weighted by +1.5 dB.
+    weights.assign(channels, 1.0);
+    if(channels == 6){
+        weights[3] = 0.0;
+        weights[4] = weights[5] = 1.41;
+    }
+
+    state.assign(4 * channels, 0.0);
+    squares.assign(channels, 0.0);
+    segmentFrames = max(1u, sampleRate / 10);
+    framesInSegment = 0;
+    peak = 0.0;
+    totalFrames = 0;
+}
+
+void LoudnessMeter::add(const float *samples, size_t frames)
+{
+    while(frames > 0)
+    {
+        size_t run = min(frames, segmentFrames - framesInSegment);
+        unsigned int channel = 0;
+        for(; channel + 1 < channels; channel += 2)
+            filter(samples, run, channel, true);
+        if(channel < channels)
+            filter(samples, run, channel, false);
+
+        framesInSegment += run;
+        totalFrames += run;
+        if(framesInSegment == segmentFrames){ // 100 ms is completed
+            double sum = 0.0;
+            for(unsigned int i=0; i<channels; i++){
+                sum += weights[i] * squares[i];
+                squares[i] = 0.0;
+            }
+            segments.push_back(sum / segmentFrames);
+            framesInSegment = 0;
+        }
+        samples += run * channels;
+        frames -= run;
+    }
+}
+
+/*
+ * State of the filters is stored as state[k*channels + channel], k = 0..3,
+ * so the state of two adjacent channels is loaded into one SSE register.
+ * Filters are in transposed direct form II:
+ *   y = b0*x + s1;  s1 = b1*x - a1*y + s2;  s2 = b2*x - a2*y;
+ */
+void LoudnessMeter::filter(const float *samples, const size_t frames, const unsigned int first, const bool pair)
+{
+    double *s1 = &state[first], *s2 = &state[channels + first];
+    double *t1 = &state[2*channels + first], *t2 = &state[3*channels + first];
+
+#if defined(__SSE2__)
+    if(pair){
+        const __m128d sb0 = _mm_set1_pd(shelf.b0), sb1 = _mm_set1_pd(shelf.b1), sb2 = _mm_set1_pd(shelf.b2);
+        const __m128d sa1 = _mm_set1_pd(shelf.a1), sa2 = _mm_set1_pd(shelf.a2);
+        const __m128d hb0 = _mm_set1_pd(highPass.b0), hb1 = _mm_set1_pd(highPass.b1), hb2 = _mm_set1_pd(highPass.b2);
+        const __m128d ha1 = _mm_set1_pd(highPass.a1), ha2 = _mm_set1_pd(highPass.a2);
+        const __m128d sign = _mm_set1_pd(-0.0);
+
+        __m128d shelf1 = _mm_loadu_pd(s1), shelf2 = _mm_loadu_pd(s2);
+        __m128d high1 = _mm_loadu_pd(t1), high2 = _mm_loadu_pd(t2);
+        __m128d sum = _mm_loadu_pd(&squares[first]);
+        __m128d maximum = _mm_setzero_pd();
+
+        const float *frame = samples + first;
+        for(size_t i=0; i<frames; i++, frame += channels){
+            __m128d x = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(frame))));
+            maximum = _mm_max_pd(maximum, _mm_andnot_pd(sign, x));
+
+            __m128d y = _mm_add_pd(_mm_mul_pd(sb0, x), shelf1);
+            shelf1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, x), _mm_mul_pd(sa1, y)), shelf2);
+            shelf2 = _mm_sub_pd(_mm_mul_pd(sb2, x), _mm_mul_pd(sa2, y));
+
+            __m128d z = _mm_add_pd(_mm_mul_pd(hb0, y), high1);
+            high1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(hb1, y), _mm_mul_pd(ha1, z)), high2);
+            high2 = _mm_sub_pd(_mm_mul_pd(hb2, y), _mm_mul_pd(ha2, z));
+
+            sum = _mm_add_pd(sum, _mm_mul_pd(z, z));
+        }
+
+        _mm_storeu_pd(s1, shelf1);
+        _mm_storeu_pd(s2, shelf2);
+        _mm_storeu_pd(t1, high1);
+        _mm_storeu_pd(t2, high2);
+        _mm_storeu_pd(&squares[first], sum);
+        double lanes[2];
+        _mm_storeu_pd(lanes, maximum);
+        peak = max(peak, max(lanes[0], lanes[1]));
+        return;
+    }
+#endif
+
+    for(unsigned int lane=0; lane < (pair ? 2u : 1u); lane++){
+        const float *frame = samples + first + lane;
+        double shelf1 = s1[lane], shelf2 = s2[lane], high1 = t1[lane], high2 = t2[lane];
+        double sum = squares[first + lane], maximum = 0.0;
+        for(size_t i=0; i<frames; i++, frame += channels){
+            double x = *frame;
+            maximum = max(maximum, fabs(x));
+
+            double y = shelf.b0*x + shelf1;
+            shelf1 = shelf.b1*x - shelf.a1*y + shelf2;
+            shelf2 = shelf.b2*x - shelf.a2*y;
+
+            double z = highPass.b0*y + high1;
+            high1 = highPass.b1*y - highPass.a1*z + high2;
+            high2 = highPass.b2*y - highPass.a2*z;
+
+            sum += z*z;
+        }
+        s1[lane] = shelf1; s2[lane] = shelf2; t1[lane] = high1; t2[lane] = high2;
+        squares[first + lane] = sum;
+        peak = max(peak, maximum);
+    }
+}
+
+double LoudnessMeter::integratedLoudness() const
+{
+    const double absoluteGate = pow(10.0, (-70.0 + 0.691) / 10.0);
+    double sum = 0.0;
+    size_t count = 0;
+    for(size_t i=3; i<segments.size(); i++){ // block of 400 ms = 4 segments of 100 ms
+        double block = (segments[i-3] + segments[i-2] + segments[i-1] + segments[i]) / 4;
+        if(block > absoluteGate){
+            sum += block;
+            count++;
+        }
+    }
+    if(count == 0)
+        return -numeric_limits<double>::infinity();
+
+    const double relativeGate = max(absoluteGate, sum / count * 0.1); // 10 LU below
+    sum = 0.0;
+    count = 0;
+    for(size_t i=3; i<segments.size(); i++){
+        double block = (segments[i-3] + segments[i-2] + segments[i-1] + segments[i]) / 4;
+        if(block > relativeGate){
+            sum += block;
+            count++;
+        }
+    }
+    return -0.691 + 10.0 * log10(sum / count);
+}
+
+double LoudnessMeter::getPeak() const { return peak; }
+unsigned long long LoudnessMeter::getFrames() const { return totalFrames; }
+
+
+/* ============= WAV DECODING ==============*/
+static unsigned int readLittleEndian(const unsigned char *data, const size_t bytes)
+{
+    unsigned int value = 0;
+    for(size_t i=0; i<bytes; i++)
+        value |= static_cast<unsigned int>(data[i]) << (8*i);
+    return value;
+}
+
+/* converts `count` samples of the PCM data to float in range -1 to 1, the format is checked once per buffer. */
+static void decodeSamples(const unsigned char *data, const size_t count, const unsigned int bits, const bool floating, float *samples)
+{
+    if(floating){
+        memcpy(samples, data, count * sizeof(float));
+        return;
+    }
+    switch(bits){
+        case 8:
+            for(size_t i=0; i<count; i++)
+                samples[i] = (static_cast<int>(data[i]) - 128) / 128.0f;
+            break;
+        case 16:
+            for(size_t i=0; i<count; i++)
+                samples[i] = static_cast<int16_t>(readLittleEndian(data + 2*i, 2)) / 32768.0f;
+            break;
+        case 24:
+            for(size_t i=0; i<count; i++)
+                samples[i] = (static_cast<int32_t>(readLittleEndian(data + 3*i, 3) << 8) >> 8) / 8388608.0f;
+            break;
+        default:
+            for(size_t i=0; i<count; i++)
+                samples[i] = static_cast<int32_t>(readLittleEndian(data + 4*i, 4)) / 2147483648.0f;
+    }
+}
+
+Loudness Loudness::analyze(const string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw runtime_error("Failed to open audio file '" + filename + "'");
+
+    struct stat status;
+    if(fstat(fd, &status) != 0 || status.st_size < 12){
+        close(fd);
+        throw runtime_error("Failed to read audio file '" + filename + "'");
+    }
+    size_t size = status.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        throw runtime_error("Failed to map audio file '" + filename + "'");
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const unsigned char *data = static_cast<const unsigned char*>(mapped);
+
+    // ---------- find the format and data chunks ----------
+    unsigned int format = 0, channels = 0, sampleRate = 0, bits = 0, frameBytes = 0;
+    const unsigned char *pcm = NULL;
+    size_t pcmSize = 0;
+    if(memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0){
+        size_t offset = 12;
+        while(offset + 8 <= size && pcm == NULL){
+            size_t chunkSize = readLittleEndian(data + offset + 4, 4);
+            const unsigned char *chunk = data + offset + 8;
+            if(memcmp(data + offset, "fmt ", 4) == 0 && chunkSize >= 16 && offset + 8 + chunkSize <= size){
+                format = readLittleEndian(chunk, 2);
+                channels = readLittleEndian(chunk + 2, 2);
+                sampleRate = readLittleEndian(chunk + 4, 4);
+                frameBytes = readLittleEndian(chunk + 12, 2);
+                bits = readLittleEndian(chunk + 14, 2);
+                if(format == 0xFFFE && chunkSize >= 26) // WAVE_FORMAT_EXTENSIBLE, format is in the sub format GUID
+                    format = readLittleEndian(chunk + 24, 2);
+            }
+            else if(memcmp(data + offset, "data", 4) == 0){
+                pcm = chunk;
+                pcmSize = min(chunkSize, size - offset - 8);
+            }
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
+    }
+
+    bool floating = format == 3 && bits == 32;
+    bool integer = format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+    if(pcm == NULL || channels == 0 || sampleRate == 0 || (!floating && !integer) || frameBytes != channels * bits / 8){
+        munmap(mapped, size);
+        throw runtime_error("Unsupported audio file '" + filename + "', only PCM WAV files are analysed");
+    }
+
+    // ---------- decode and measure ----------
+#if defined(__SSE2__)
+    // the filters decay to denormals in the silence, which are very slow, so they are flushed to zero.
+    unsigned int floatingPointMode = _mm_getcsr();
+    _mm_setcsr(floatingPointMode | 0x8040); // flush to zero and denormals are zero
+#endif
+
+    LoudnessMeter meter(sampleRate, channels);
+    const size_t bufferFrames = 4096;
+    vector<float> buffer(bufferFrames * channels);
+    size_t totalFrames = pcmSize / frameBytes;
+    for(size_t frame=0; frame<totalFrames; frame+=bufferFrames){
+        size_t frames = min(bufferFrames, totalFrames - frame);
+        decodeSamples(pcm + frame * frameBytes, frames * channels, bits, floating, buffer.data());
+        meter.add(buffer.data(), frames);
+    }
+    munmap(mapped, size);
+
+#if defined(__SSE2__)
+    _mm_setcsr(floatingPointMode);
+#endif
+
+    Loudness loudness;
+    loudness.integrated = meter.integratedLoudness();
+    loudness.peak = meter.getPeak();
+    loudness.duration = static_cast<double>(totalFrames) / sampleRate;
+    loudness.fileSize = size;
+    loudness.fileModified = status.st_mtime;
+    return loudness;
+}
+
+double Loudness::gainDb() const
+{
+    if(!isfinite(integrated)) // silence is not amplified
+        return 0.0;
+    double gain = TARGET_LUFS - integrated;
+    if(peak > 0.0)
+        gain = min(gain, -20.0 * log10(peak)); // never clip the peak
+    return gain;
+}
+
+float Loudness::gain() const {
+    return static_cast<float>(pow(10.0, gainDb() / 20.0));
+}
+
+
+/* ============= LOUDNESS CACHE ==============*/
+LoudnessCache::LoudnessCache(){
+    filename = "loudness.cache";
+    loaded = false;
+    MUTEX_NAME(cache_lock, "LoudnessCache::cache_lock");
+}
+
+LoudnessCache* LoudnessCache::get(){
+    static LoudnessCache cache;
+    return &cache;
+}
+
+void LoudnessCache::setFilename(const string &filename){
+    lock_guard<PlayerMutex> lock(MUTEX_SITE(cache_lock));
+    this->filename = filename;
+    results.clear();
+    loaded = false;
+}
+
+void LoudnessCache::load()
+{
+    if(loaded)
+        return;
+    loaded = true;
+
+    FILE *file = fopen(filename.c_str(), "rb");
+    if(file == NULL)
+        return; // nothing is analysed yet
+
+    char magic[sizeof(CACHE_MAGIC)];
+    unsigned long long count = 0;
+    bool valid = fread(magic, sizeof(magic), 1, file) == 1
+              && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0
+              && fread(&count, sizeof(count), 1, file) == 1;
+    for(unsigned long long i=0; valid && i<count; i++){
+        unsigned int pathLength = 0;
+        Loudness loudness;
+        valid = fread(&pathLength, sizeof(pathLength), 1, file) == 1 && pathLength > 0 && pathLength < 4096;
+        string path(valid ? pathLength : 0, '\0');
+        valid = valid
+             && fread(path.data(), pathLength, 1, file) == 1
+             && fread(&loudness.integrated, sizeof(loudness.integrated), 1, file) == 1
+             && fread(&loudness.peak, sizeof(loudness.peak), 1, file) == 1
+             && fread(&loudness.duration, sizeof(loudness.duration), 1, file) == 1
+             && fread(&loudness.fileSize, sizeof(loudness.fileSize), 1, file) == 1
+             && fread(&loudness.fileModified, sizeof(loudness.fileModified), 1, file) == 1;
+        if(valid)
+            results[path] = loudness;
+    }
+    fclose(file);
+    if(!valid)
+        LOG(warning, "Loudness cache '" + filename + "' is invalid, the songs will be analysed again");
+}
+
+bool LoudnessCache::save() const
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(file == NULL)
+        return false;
+
+    unsigned long long count = results.size();
+    bool written = fwrite(CACHE_MAGIC, sizeof(CACHE_MAGIC), 1, file) == 1
+                && fwrite(&count, sizeof(count), 1, file) == 1;
+    for(auto result = results.begin(); written && result != results.end(); ++result){
+        unsigned int pathLength = result->first.size();
+        const Loudness &loudness = result->second;
+        written = fwrite(&pathLength, sizeof(pathLength), 1, file) == 1
+               && fwrite(result->first.data(), pathLength, 1, file) == 1
+               && fwrite(&loudness.integrated, sizeof(loudness.integrated), 1, file) == 1
+               && fwrite(&loudness.peak, sizeof(loudness.peak), 1, file) == 1
+               && fwrite(&loudness.duration, sizeof(loudness.duration), 1, file) == 1
+               && fwrite(&loudness.fileSize, sizeof(loudness.fileSize), 1, file) == 1
+               && fwrite(&loudness.fileModified, sizeof(loudness.fileModified), 1, file) == 1;
+    }
+    return fclose(file) == 0 && written;
+}
+
+bool LoudnessCache::find(const Song &song, Loudness &loudness)
+{
+    string_view audioPath = song.getAudioPath();
+    if(audioPath.empty())
+        return false;
+    {
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(cache_lock));
+        load();
+        auto found = results.find(audioPath);
+        if(found == results.end())
+            return false;
+        loudness = found->second;
+    }
+    return sameFile(string(audioPath), loudness); // stat() without the lock
+}
+
+LoudnessCache::Report LoudnessCache::analyze(const vector<Song> &songs, unsigned int threads)
+{
+    steady_clock::time_point begin = steady_clock::now();
+    Report report = {};
+
+    // ---------- copy the cached results, and check the files without the lock ----------
+    vector<pair<string_view, Loudness>> candidates;
+    vector<bool> cached;
+    {
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(cache_lock));
+        load();
+        unordered_set<string_view> seen;
+        for(const Song &song : songs){
+            string_view audioPath = song.getAudioPath();
+            if(audioPath.empty() || !seen.insert(audioPath).second)
+                continue;
+            auto found = results.find(audioPath);
+            cached.push_back(found != results.end());
+            candidates.emplace_back(audioPath, cached.back() ? found->second : Loudness());
+        }
+    }
+    report.songs = candidates.size();
+
+    vector<string> pending;
+    for(size_t i=0; i<candidates.size(); i++){
+        string audioPath(candidates[i].first);
+        if(cached[i] && sameFile(audioPath, candidates[i].second))
+            report.cached++;
+        else
+            pending.push_back(audioPath);
+    }
+
+    // ---------- analyse the pending files in parallel ----------
+    if(threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    report.threads = static_cast<unsigned int>(min<size_t>(threads, max<size_t>(pending.size(), 1)));
+
+    vector<Loudness> analysed(pending.size());
+    vector<char> succeeded(pending.size(), 0);
+    atomic<size_t> next(0);
+    auto worker = [&](){
+        for(size_t i; (i = next.fetch_add(1, memory_order_relaxed)) < pending.size(); ){
+            try {
+                analysed[i] = Loudness::analyze(pending[i]);
+                succeeded[i] = 1;
+                LOGF(debug, "Loudness of '%s': %.2f LUFS, peak %.2f dBFS", pending[i].c_str(),
+                     analysed[i].integrated, 20.0 * log10(analysed[i].peak));
+            } catch (const exception &e) {
+                LOG(warning, e.what());
+            }
+        }
+    };
+    vector<thread> workers;
+    for(unsigned int i=1; i<report.threads; i++)
+        workers.emplace_back(worker);
+    worker();
+    for(thread &t : workers)
+        t.join();
+
+    // ---------- merge and save the results ----------
+    {
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(cache_lock));
+        for(size_t i=0; i<pending.size(); i++){
+            if(!succeeded[i]){
+                report.failed++;
+                continue;
+            }
+            results[pending[i]] = analysed[i];
+            report.analyzed++;
+            report.audioSeconds += analysed[i].duration;
+        }
+        if(report.analyzed > 0 && !save())
+            LOG(warning, "Failed to save the loudness cache '" + filename + "'");
+    }
+
+    report.wallSeconds = duration<double>(steady_clock::now() - begin).count();
+    return report;
+}
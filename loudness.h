@@ -0,0 +1,211 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include "song.h"
+#include "profiledmutex.h"
+
+
+/***********************************************************************************************************//**
+ * @class LoudnessMeter
+ * @brief LoudnessMeter measures the integrated loudness (EBU R128 / ITU-R BS.1770) and the sample peak of audio.
+ *
+ * Samples are filtered by the K-weighting filters (a high shelf followed by a high pass biquad),
+ * and the mean square of every 100 ms is kept.\n
+ * Integrated loudness is computed from the 400 ms blocks (75% overlap) of those, gated by the absolute
+ * gate (-70 LUFS) and then by the relative gate (10 LU below the loudness of the blocks above the absolute gate).\n
+ * Filters run in double precision, and with SSE2 two channels (i.e. left and right) are filtered at once.
+ **************************************************************************************************************/
+class LoudnessMeter
+{
+public:
+
+    /*********************************************************************//**
+     * @brief LoudnessMeter computes the filter coefficients for the sample rate.
+     * @param sampleRate is the number of frames per second.
+     * @param channels is the number of samples per frame.
+     ************************************************************************/
+    LoudnessMeter(const unsigned int sampleRate, const unsigned int channels);
+
+    /*****************************************************************************//**
+     * @brief add measures the next frames of the audio.
+     * @param samples are `frames` interleaved frames, in range -1 to 1.
+     * @param frames is the number of frames.
+     ********************************************************************************/
+    void add(const float *samples, const size_t frames);
+
+    /** @brief integrated loudness in LUFS, or -infinity if the audio is (nearly) silent. */
+    double integratedLoudness() const;
+
+    /** @brief sample peak (linear, 1 is full scale). */
+    double getPeak() const;
+
+    /** @brief number of the frames measured. */
+    unsigned long long getFrames() const;
+
+private:
+
+    /** @brief coefficients of a biquad filter (a0 is normalized to 1). */
+    struct Biquad { double b0, b1, b2, a1, a2; };
+
+    /** @brief filters the frames of channels `first` and `first+1` (or only `first` if `pair` is false). */
+    void filter(const float *samples, const size_t frames, const unsigned int first, const bool pair);
+
+    /** @brief number of samples per frame. */
+    unsigned int channels;
+
+    /** @brief K-weighting pre-filter (high shelf). */
+    Biquad shelf;
+
+    /** @brief K-weighting RLB filter (high pass). */
+    Biquad highPass;
+
+    /** @brief state of the filters, 4 values (2 per biquad) for every channel. */
+    std::vector<double> state;
+
+    /** @brief weight of every channel (surround channels are louder, LFE is ignored). */
+    std::vector<double> weights;
+
+    /** @brief sum of the squares of the filtered samples of every channel, in the current 100 ms. */
+    std::vector<double> squares;
+
+    /** @brief number of the frames in 100 ms. */
+    size_t segmentFrames;
+
+    /** @brief number of the frames in the current 100 ms. */
+    size_t framesInSegment;
+
+    /** @brief weighted mean square of every completed 100 ms. */
+    std::vector<double> segments;
+
+    /** @brief sample peak. */
+    double peak;
+
+    /** @brief number of the frames measured. */
+    unsigned long long totalFrames;
+};
+
+
+/*********************************************************************************************//**
+ * @struct Loudness
+ * @brief Loudness is the result of the analysis of an audio file.
+ ************************************************************************************************/
+struct Loudness
+{
+    /** @brief reference loudness of the ReplayGain 2.0, to which the songs are normalized. */
+    static constexpr double TARGET_LUFS = -18.0;
+
+    /** @brief integrated loudness in LUFS. */
+    double integrated;
+
+    /** @brief sample peak (linear). */
+    double peak;
+
+    /** @brief duration of the audio in seconds. */
+    double duration;
+
+    /** @brief size of the audio file while analysing. */
+    unsigned long long fileSize;
+
+    /** @brief modification time of the audio file while analysing. */
+    long long fileModified;
+
+    /** @brief gain (in dB) which brings the song to `TARGET_LUFS`, reduced if the peak would clip. */
+    double gainDb() const;
+
+    /** @brief linear gain of `gainDb()`, to be given as the volume of the [AudioRenderer](@ref AudioRenderer). */
+    float gain() const;
+
+    /*****************************************************************************************//**
+     * @brief analyze decodes the WAV (PCM 16/24/32 bit or float) file and measures its loudness.
+     * @param filename is the path of the audio file.
+     * @return loudness of the file, it throws `std::runtime_error` if the file can not be decoded.
+     ********************************************************************************************/
+    static Loudness analyze(const std::string &filename);
+};
+
+
+/*****************************************************************************************************//**
+ * @class LoudnessCache
+ * @brief LoudnessCache keeps the loudness of the songs, so playback applies the gain without analysing again.
+ *
+ * It is a singleton like the [SeekTableCache](@ref SeekTableCache).\n
+ * Results are keyed by the audio path of the song (ids of the songs change with every run), and are saved
+ * into the cache file (default `loudness.cache`), along with the size and modification time of the audio file.\n
+ * `analyze()` analyses only the new or changed files, in parallel on all the cores.
+ ********************************************************************************************************/
+class LoudnessCache
+{
+public:
+
+    /** @brief Report is the summary of an `analyze()` run. */
+    struct Report {
+        /** @brief number of the songs with an audio file. */
+        size_t songs;
+        /** @brief number of the files analysed in this run. */
+        size_t analyzed;
+        /** @brief number of the files whose cached result is still valid. */
+        size_t cached;
+        /** @brief number of the files which could not be analysed. */
+        size_t failed;
+        /** @brief number of the threads used. */
+        unsigned int threads;
+        /** @brief duration (in seconds) of the audio analysed in this run. */
+        double audioSeconds;
+        /** @brief wall clock time (in seconds) of the run. */
+        double wallSeconds;
+    };
+
+    /** @brief returns the singleton instance of the cache. */
+    static LoudnessCache* get();
+
+    /** @brief sets the file in which the results are saved, and reloads the results from it. */
+    void setFilename(const std::string &filename);
+
+    /***********************************************************************************//**
+     * @brief find returns the cached loudness of the song, it never analyses the file.
+     * @param song whose loudness is needed.
+     * @param loudness is filled with the cached result.
+     * @return false if the song is not analysed yet.
+     **************************************************************************************/
+    bool find(const Song &song, Loudness &loudness);
+
+    /************************************************************************************************//**
+     * @brief analyze analyses the new or changed audio files of the songs in parallel, and saves the cache.
+     * @param songs of the library, songs without an audio path are skipped.
+     * @param threads is the number of the worker threads (default 0 means all the cores).
+     * @return summary of the run.
+     ***************************************************************************************************/
+    Report analyze(const std::vector<Song> &songs, unsigned int threads = 0);
+
+private:
+
+    /** @brief private constructor of the singleton. */
+    LoudnessCache();
+
+    LoudnessCache(const LoudnessCache &) = delete;
+    LoudnessCache& operator= (const LoudnessCache &) = delete;
+
+    /** @brief loads the cache file if it is not loaded yet, `cache_lock` must be held. */
+    void load();
+
+    /** @brief writes the results into the cache file, `cache_lock` must be held. */
+    bool save() const;
+
+    /** @brief filename is the path of the cache file. */
+    std::string filename;
+
+    /** @brief loaded tells whether the cache file is read or not. */
+    bool loaded;
+
+    /** @brief results maps the audio path to the loudness of the file. */
+    std::map<std::string, Loudness, std::less<>> results;
+
+    /** @brief cache_lock protects all the members. */
+    PlayerMutex cache_lock;
+};
+
+#endif // LOUDNESS_H
@@ -1,8 +1,17 @@
 #include <iostream>
 #include <thread>
+#include <cstdlib>  // for strtoul()
+#include <filesystem>
+#include <csignal>
+#include <cmath>
 #include "displayplaylist.h"
 #include "song.h"
 #include "logger.h"
+#include "audiorenderer.h"
+#include "spectrumvisualizer.h"
+#include "loudness.h"
+#include "seektable.h"
+#include "controlserver.h"
 
 using namespace std;
 
@@ -15,6 +24,62 @@ using namespace std;
  *************************************************************************************************************/
 void push_songs_into_playlist(DisplayPlaylist &playlist);
 
+/*************************************************************************************************************//**
+ * @brief simulate_playlist fast-forwards a playlist of `totalSongs` songs on a [VirtualClock](@ref VirtualClock).
+ *
+ * It is used to soak-test long sessions, and to measure the throughput of the player threads.\n
+ * Screen and console outputs are disabled, logs are still written into the log file with virtual timestamps.\n
+ * At the end, it displays the number of songs played per second of the wall clock.
+ * @param totalSongs is the number of songs to play.
+ * @return 0 on successfull execution, else returns 1.
+ ****************************************************************************************************************/
+int simulate_playlist(const unsigned long totalSongs);
+
+/*************************************************************************************************************//**
+ * @brief render_test plays a test tone on the [AudioRenderer](@ref AudioRenderer), and reports the missed deadlines.
+ *
+ * Tone is played as a song of a [DisplayPlaylist](@ref DisplayPlaylist) whose renderer is set, so the playlist
+ * applies the loudness gain of the song (the gain of `audioPath`, if it is analysed by `--analyze-loudness`).\n
+ * It requests the `SCHED_FIFO` priority for the render thread, and sends play, volume, pause and seek commands
+ * while the tone is being played.\n
+ * If `audioPath` is an MPEG audio file, the file is played instead of the tone (as silence, there is no decoder),
+ * so the seek to its middle goes through its [SeekTable](@ref SeekTable), see [MpegFileSource](@ref MpegFileSource).\n
+ * A [SpectrumVisualizer](@ref SpectrumVisualizer) analyses the played audio at 60 frames per second meanwhile.\n
+ * At the end, it displays the rendered periods, underruns and maximum lateness of the render thread,
+ * and the CPU load of the visualizer thread.
+ * @param seconds is the length of the test tone.
+ * @param visualize draws the spectrum and VU level on the screen.
+ * @param audioPath is the audio file whose loudness gain is applied to the tone (default empty, unity gain), or the MPEG audio file to play.
+ * @return 0 if no deadline is missed, else returns 1.
+ ****************************************************************************************************************/
+int render_test(const unsigned long seconds, const bool visualize, const std::string &audioPath = "");
+
+/*************************************************************************************************************//**
+ * @brief analyze_loudness analyses the loudness of all the WAV files in the directory (and its sub directories).
+ *
+ * Results are saved by the [LoudnessCache](@ref LoudnessCache), so running it again analyses only the new or
+ * changed files.\n
+ * At the end, it displays the number of the analysed, cached and failed files, and the throughput
+ * in hours of audio analysed per second.
+ * @param directory is the music library.
+ * @param threads is the number of the worker threads (0 means all the cores).
+ * @return 0 if all the files are analysed, else returns 1.
+ ****************************************************************************************************************/
+int analyze_loudness(const std::string &directory, const unsigned int threads);
+
+/*************************************************************************************************************//**
+ * @brief serve plays the songs enqueued by the clients of the [ControlServer](@ref ControlServer).
+ *
+ * The playlist starts empty and waits for the songs (keep alive mode), with the screen and console outputs disabled.\n
+ * On `SIGINT` or `SIGTERM`, keep alive is disabled, so the enqueued songs are played till the end,
+ * then the server is stopped and its statistics are displayed.
+ * @param socketPath is the path of the Unix domain socket.
+ * @param maxConnections is the maximum number of the clients connected at once.
+ * @param libraryRoot is the directory of the audio files the clients may enqueue (empty, no audio files).
+ * @return 0 on successfull execution, else returns 1.
+ ****************************************************************************************************************/
+int serve(const std::string &socketPath, const size_t maxConnections, const std::string &libraryRoot);
+
 /*****************************************************************//**
  * @brief main method is used to handle the flow of the program.
  *
@@ -25,11 +90,44 @@ void push_songs_into_playlist(DisplayPlaylist &playlist);
  * 2. for DisplayPlaylist::playNextSong() method.
  * 3. for DisplayPlaylist::checkForException() method.
  * .
+ * Run it with `--simulate <number of songs>` to fast-forward a long playlist, see simulate_playlist().\n
+ * Add `--compress-logs` after it, to write the compressed logs into `logs.log.lz`.\n
+ * Run it with `--render <seconds>` to test the real-time render thread, see render_test().\n
+ * Add `--visualize` after it, to draw the spectrum of the played audio,
+ * and the path of an analysed audio file, to apply its loudness gain to the tone.\n
+ * Run it with `--analyze-loudness <directory> [threads]` to analyse the loudness of the library, see analyze_loudness().\n
+ * Run it with `--serve <socket path> [max connections] [library directory]` to drive the player from the local clients, see serve().\n
+ * When it is built with `MUTEX_PROFILING`, the profile of all the mutexes is displayed at the end, in every mode.
  * @return 0 on successfull execution, else returns 1.
  *******************************************************************/
-int main()
+int main(int argc, char *argv[])
 {
     unique_ptr<Logger> logger(Logger::get());
+#ifdef MUTEX_PROFILING
+    // profile of all the mutexes is displayed however main() returns, the destroyed mutexes keep their report.
+    struct MutexReport { ~MutexReport(){ ProfiledMutex::reportAll(); } } mutexReport;
+#endif
+    if(argc >= 3 && string(argv[1]) == "--simulate"){
+        if(argc == 4 && string(argv[3]) == "--compress-logs")
+            Logger::get()->enableFileCompression("logs.log.lz");
+        return simulate_playlist(strtoul(argv[2], NULL, 10));
+    }
+    if(argc >= 3 && string(argv[1]) == "--render"){
+        bool visualize = false;
+        string audioPath;
+        for(int i=3; i<argc; i++){
+            if(string(argv[i]) == "--visualize")
+                visualize = true;
+            else
+                audioPath = argv[i];
+        }
+        return render_test(strtoul(argv[2], NULL, 10), visualize, audioPath);
+    }
+    if(argc >= 3 && string(argv[1]) == "--analyze-loudness")
+        return analyze_loudness(argv[2], argc == 4 ? strtoul(argv[3], NULL, 10) : 0);
+    if(argc >= 3 && string(argv[1]) == "--serve")
+        return serve(argv[2], argc >= 4 ? strtoul(argv[3], NULL, 10) : 4096, argc >= 5 ? argv[4] : "");
+
     try {
         LOG(error, "Execution Begin");
 
@@ -61,16 +159,249 @@ void push_songs_into_playlist(DisplayPlaylist &playlist)
 {
     try {
         LOG(trace, "Pushing the songs");
-        Song song1("Daku", chrono::seconds(1), "/thumbnails/daku.jpeg");
-        Song song2("Shape of You", chrono::seconds(1), "/thumbnails/shape_of_you.jpeg");
-        Song song3("Dandelion", chrono::seconds(1), "/thumbnails/dandelion.jpeg");
-
-        playlist.pushSongIntoPlaylist(song1);
-        playlist.pushSongIntoPlaylist(song2);
-        playlist.pushSongIntoPlaylist(song3);
+        playlist.emplaceSongIntoPlaylist("Daku", chrono::seconds(1), "/thumbnails/daku.jpeg");
+        playlist.emplaceSongIntoPlaylist("Shape of You", chrono::seconds(1), "/thumbnails/shape_of_you.jpeg");
+        playlist.emplaceSongIntoPlaylist("Dandelion", chrono::seconds(1), "/thumbnails/dandelion.jpeg");
         LOG(trace, "Pushed all songs");
     }
     catch (const exception &e) {
         LOG(error, e.what());
     }
 }
+
+int simulate_playlist(const unsigned long totalSongs)
+{
+    VirtualClock clock;
+    Logger::get()->setClock(&clock);
+    Logger::get()->disableConsoleOutput();
+    int returnValueOfExceptionThread = 1;
+
+    try {
+        LOG(info, "Simulating playlist of " + to_string(totalSongs) + " songs");
+
+        DisplayPlaylist playlist(&clock);
+        playlist.disableScreenOutput();
+        playlist.reservePlaylist(totalSongs);
+        for(unsigned long i=1; i<=totalSongs; i++)
+            playlist.emplaceSongIntoPlaylist("Song " + to_string(i), chrono::seconds(120 + i%240), "/thumbnails/song.jpeg");
+
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+        thread t_playSongs(&DisplayPlaylist::playPlaylist, &playlist);
+        thread t_monitorException(&DisplayPlaylist::monitorException, &playlist, ref(returnValueOfExceptionThread));
+        thread t_changeSong(&DisplayPlaylist::playNextSong, &playlist);
+        t_playSongs.join();
+        t_changeSong.join();
+        t_monitorException.join();
+
+        double wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        double virtualHours = chrono::duration<double, ratio<3600>>(clock.elapsed()).count();
+
+        printf("\n  ===== SIMULATION =====\n");
+        printf("\tSongs played  : %lu\n", totalSongs);
+        printf("\tVirtual time  : %.1f hours\n", virtualHours);
+        printf("\tWall time     : %.3f seconds\n", wallSeconds);
+        printf("\tThroughput    : %.0f songs/second\n", totalSongs / wallSeconds);
+        LOG(info, "Simulation completed");
+    }
+    catch (const exception &e) {
+        LOG(error, e.what());
+        returnValueOfExceptionThread = 1;
+    }
+
+    // clock is going out of scope, so logger must go back to the real time clock.
+    Logger::get()->setClock(NULL);
+    return returnValueOfExceptionThread;
+}
+
+/*****************************************************************************************************//**
+ * @brief ToneStarter loads and plays the test tone on the renderer, when its song starts in the playlist.
+ *
+ * Playlist sets the volume of the renderer just before, on the same thread, so after `started` is seen
+ * the render test can send the next commands (the command queue of the renderer has a single producer).
+ ********************************************************************************************************/
+class ToneStarter : public PlaylistListener
+{
+public:
+    ToneStarter(AudioRenderer *renderer, AudioSource *tone) : renderer(renderer), tone(tone), gainDb(0), started(false) {}
+
+    void songStarted(const Song &song) override {
+        gainDb = song.getGainDb();
+        renderer->load(tone);
+        renderer->play();
+        started = true;
+    }
+
+    void songFinished(const Song &) override {}
+
+    AudioRenderer *renderer;
+    AudioSource *tone;
+    double gainDb;
+    atomic<bool> started;
+};
+
+int render_test(const unsigned long seconds, const bool visualize, const string &audioPath)
+{
+    int returnValueOfExceptionThread = 1;
+    try {
+        AudioRenderer renderer;
+        if(!renderer.start(true))
+            LOG(warning, "SCHED_FIFO is not granted to the render thread, running with normal priority");
+
+        SpectrumVisualizer visualizer(&renderer);
+        if(visualize){
+            Logger::get()->disableConsoleOutput(); // logs would break the line of the spectrum
+            visualizer.enableScreenOutput();
+        }
+        visualizer.start();
+
+        // tone is played by the playlist, which sets the volume of the renderer to the loudness gain of the song.
+        DisplayPlaylist playlist;
+        playlist.disableScreenOutput();
+        playlist.setRenderer(&renderer);
+        Song song("Test tone", chrono::seconds(seconds), "", audioPath);
+        playlist.pushSongIntoPlaylist(song); // seek table of the song is built here, if it is MPEG audio
+
+        ToneSource tone(440, chrono::seconds(seconds), renderer.getSampleRate());
+        AudioSource *source = &tone;
+        unsigned long long middle = renderer.getSampleRate() * seconds / 2;
+        unique_ptr<MpegFileSource> file;
+        if(SeekTable::isMpegAudio(audioPath)){
+            shared_ptr<const SeekTable> table = SeekTableCache::get()->find(song);
+            if(table != nullptr){
+                file = make_unique<MpegFileSource>(audioPath, table);
+                source = file.get();
+                middle = table->getDuration().count() * table->getSampleRate() / 2000000;
+            }
+        }
+        ToneStarter starter(&renderer, source);
+        playlist.setListener(&starter);
+
+        thread t_playSongs(&DisplayPlaylist::playPlaylist, &playlist);
+        thread t_monitorException(&DisplayPlaylist::monitorException, &playlist, ref(returnValueOfExceptionThread));
+        thread t_changeSong(&DisplayPlaylist::playNextSong, &playlist);
+        while(!starter.started)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        LOG(info, "Render test started");
+
+        // exercise the transport commands while the tone is being played.
+        chrono::milliseconds step(seconds*1000/4);
+        this_thread::sleep_for(step);
+        renderer.setVolume(static_cast<float>(pow(10.0, starter.gainDb / 20.0)) * 0.5f);
+        renderer.pause();
+        this_thread::sleep_for(step);
+        renderer.play();
+        renderer.seek(middle);
+
+        while(renderer.getFinishedSongs() == 0)
+            this_thread::sleep_for(chrono::milliseconds(10));
+        t_playSongs.join();
+        t_changeSong.join();
+        t_monitorException.join();
+        visualizer.stop();
+        renderer.stop();
+
+        printf("\n  ===== RENDER TEST =====\n");
+        printf("\tSCHED_FIFO    : %s\n", renderer.isRealTimePriority() ? "yes" : "no");
+        printf("\tGain          : %+.1f dB\n", starter.gainDb);
+        printf("\tPeriods       : %llu\n", renderer.getPeriods());
+        printf("\tUnderruns     : %llu\n", renderer.getUnderruns());
+        printf("\tMax lateness  : %.3f ms\n", renderer.getMaxLateness().count() / 1e6);
+        printf("\tSpectrum      : %llu frames, %.2f%% of a core\n", visualizer.getFrames(), visualizer.getLoad() * 100);
+        LOG(info, "Render test completed, underruns: " + to_string(renderer.getUnderruns()));
+        return renderer.getUnderruns() == 0 ? returnValueOfExceptionThread : 1;
+    }
+    catch (const exception &e) {
+        LOG(error, e.what());
+        return 1;
+    }
+}
+
+int analyze_loudness(const string &directory, const unsigned int threads)
+{
+    try {
+        vector<Song> songs;
+        for(const filesystem::directory_entry &entry : filesystem::recursive_directory_iterator(directory)){
+            string extension = entry.path().extension().string();
+            if(entry.is_regular_file() && (extension == ".wav" || extension == ".WAV"))
+                songs.emplace_back(entry.path().stem().string(), chrono::seconds(0), "", entry.path().string());
+        }
+        LOG(info, "Analysing loudness of " + to_string(songs.size()) + " songs in '" + directory + "'");
+
+        LoudnessCache::Report report = LoudnessCache::get()->analyze(songs, threads);
+
+        printf("\n  ===== LOUDNESS ANALYSIS =====\n");
+        printf("\tSongs         : %zu\n", report.songs);
+        printf("\tAnalysed      : %zu\n", report.analyzed);
+        printf("\tCached        : %zu\n", report.cached);
+        printf("\tFailed        : %zu\n", report.failed);
+        printf("\tThreads       : %u\n", report.threads);
+        printf("\tAudio         : %.2f hours\n", report.audioSeconds / 3600);
+        printf("\tWall time     : %.3f seconds\n", report.wallSeconds);
+        if(report.wallSeconds > 0)
+            printf("\tThroughput    : %.2f hours of audio/second\n", report.audioSeconds / 3600 / report.wallSeconds);
+        LOG(info, "Loudness analysis completed");
+        return report.failed == 0 ? 0 : 1;
+    }
+    catch (const exception &e) {
+        LOG(error, e.what());
+        return 1;
+    }
+}
+
+/* stopRequested is set by the signal handler of serve(). */
+static atomic<bool> stopRequested(false);
+
+static void requestStop(int){
+    stopRequested = true;
+}
+
+int serve(const string &socketPath, const size_t maxConnections, const string &libraryRoot)
+{
+    Logger::get()->disableConsoleOutput();
+    int returnValueOfExceptionThread = 1;
+
+    try {
+        DisplayPlaylist playlist;
+        playlist.disableScreenOutput();
+        playlist.setKeepAlive(true);
+
+        ControlServer server(&playlist, socketPath, maxConnections);
+        playlist.setListener(&server);
+        if(!libraryRoot.empty())
+            server.setLibraryRoot(libraryRoot);
+        server.start();
+
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+        printf("Listening on '%s', press Ctrl+C to stop\n", socketPath.c_str());
+
+        thread t_playSongs(&DisplayPlaylist::playPlaylist, &playlist);
+        thread t_monitorException(&DisplayPlaylist::monitorException, &playlist, ref(returnValueOfExceptionThread));
+        thread t_changeSong(&DisplayPlaylist::playNextSong, &playlist);
+
+        while(!stopRequested)
+            this_thread::sleep_for(chrono::milliseconds(100));
+
+        printf("Stopping after %zu enqueued songs\n", playlist.getPendingSongs());
+        playlist.setKeepAlive(false);
+        t_playSongs.join();
+        t_changeSong.join();
+        t_monitorException.join();
+
+        // listener of the playlist is not used anymore, so the server can be stopped.
+        server.stop();
+        ControlServer::Statistics statistics = server.getStatistics();
+        printf("\n  ===== CONTROL SERVER =====\n");
+        printf("\tConnections   : %llu accepted, %llu rejected\n", statistics.accepted, statistics.rejected);
+        printf("\tRequests      : %llu\n", statistics.requests);
+        printf("\tEvents        : %llu sent, %llu dropped\n", statistics.events, statistics.droppedEvents);
+        LOG(info, "Control server completed, requests: " + to_string(statistics.requests));
+    }
+    catch (const exception &e) {
+        LOG(error, e.what());
+        printf("%s\n", e.what());
+        return 1;
+    }
+    return returnValueOfExceptionThread;
+}
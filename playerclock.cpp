@@ -0,0 +1,51 @@
+#include "playerclock.h"
+#include <thread>
+#include <stdexcept>
+
+using namespace std;
+using namespace std::chrono;
+
+/* ============= PLAYER CLOCK ==============*/
+PlayerClock::~PlayerClock(){}
+
+PlayerClock* PlayerClock::realTime(){
+    static RealClock clock;
+    return &clock;
+}
+
+
+/* ============= REAL CLOCK ==============*/
+system_clock::time_point RealClock::now(){
+    return system_clock::now();
+}
+
+void RealClock::sleepFor(const nanoseconds &duration){
+    this_thread::sleep_for(duration);
+}
+
+
+/* ============= VIRTUAL CLOCK ==============*/
+VirtualClock::VirtualClock(){
+    start = system_clock::now();
+    elapsedTime = 0;
+    sleeper = thread::id();
+}
+
+system_clock::time_point VirtualClock::now(){
+    return start + duration_cast<system_clock::duration>(nanoseconds(elapsedTime.load()));
+}
+
+void VirtualClock::sleepFor(const nanoseconds &duration)
+{
+    thread::id noSleeper, self = this_thread::get_id();
+    if(!sleeper.compare_exchange_strong(noSleeper, self) && noSleeper != self)
+        throw logic_error("VirtualClock supports a single sleeping thread");
+
+    // the only sleeper wakes up at the next event, so the clock jumps to its wake up time (never backward).
+    if(duration.count() > 0)
+        elapsedTime.fetch_add(duration.count());
+}
+
+nanoseconds VirtualClock::elapsed() const{
+    return nanoseconds(elapsedTime.load());
+}
@@ -0,0 +1,109 @@
+#ifndef PLAYERCLOCK_H
+#define PLAYERCLOCK_H
+
+#include <chrono>
+#include <atomic>
+#include <thread>   // to use std::thread::id
+
+
+/***************************************************************************************************//**
+ * @class PlayerClock
+ * @brief PlayerClock is an abstract clock, used by the player to wait and by the logger for timestamps.
+ *
+ * The player never calls `std::this_thread::sleep_for()` or `system_clock::now()` directly,
+ * instead it asks the clock injected into it.\n
+ * So the same code can run on
+ * 1. [RealClock](@ref RealClock), which really sleeps (default).
+ * 2. [VirtualClock](@ref VirtualClock), which jumps straight to the time the sleeper wants to wake up.
+ ******************************************************************************************************/
+class PlayerClock
+{
+public:
+
+    /** @brief ~PlayerClock virtual destructor. */
+    virtual ~PlayerClock();
+
+    /****************************************************//**
+     * @brief now returns the current time of the clock.
+     * @return current time point of the clock.
+     *******************************************************/
+    virtual std::chrono::system_clock::time_point now() = 0;
+
+    /*******************************************************************//**
+     * @brief sleepFor blocks the calling thread for the given duration of the clock.
+     * @param duration is the time to sleep.
+     **********************************************************************/
+    virtual void sleepFor(const std::chrono::nanoseconds &duration) = 0;
+
+    /*****************************************************************//**
+     * @brief realTime returns the shared wall clock used by default.
+     * @return pointer to the singleton [RealClock](@ref RealClock).
+     ********************************************************************/
+    static PlayerClock* realTime();
+};
+
+
+/*****************************************************************//**
+ * @class RealClock
+ * @brief RealClock uses the system clock and really sleeps.
+ ********************************************************************/
+class RealClock : public PlayerClock
+{
+public:
+    std::chrono::system_clock::time_point now() override;
+    void sleepFor(const std::chrono::nanoseconds &duration) override;
+};
+
+
+/*********************************************************************************************************//**
+ * @class VirtualClock
+ * @brief VirtualClock is used to fast-forward the playback, i.e. to simulate very long playlists.
+ *
+ * It starts at the current system time, and moves forward only when someone sleeps on it.\n
+ * `sleepFor()` does not block, it advances the clock directly to the wake up time of the sleeper
+ * (the next scheduled event), so the playlist runs as fast as CPU allows.\n
+ * Order of the events is still decided by the mutexes and condition variables of the player,
+ * so the events and logs are same as the real time execution, only timestamps are virtual.\n
+ * It supports a single sleeping thread (the thread playing the songs): the virtual time is the timeline of
+ * that thread, so its next wake up time is always the next event.\n
+ * With more sleepers, the next event would be the earliest wake up time of all of them,
+ * which can not be known without knowing which threads are still running,
+ * so `sleepFor()` throws `std::logic_error` if it is called from a second thread.
+ ************************************************************************************************************/
+class VirtualClock : public PlayerClock
+{
+public:
+
+    /** @brief VirtualClock starts the virtual time from current system time. */
+    VirtualClock();
+
+    std::chrono::system_clock::time_point now() override;
+
+    /*************************************************************************************************//**
+     * @brief sleepFor advances the clock by the duration, without blocking.
+     * @param duration is the time to sleep.
+     *
+     * The first thread calling it becomes the sleeper of the clock, it throws `std::logic_error`
+     * if it is called from any other thread.
+     ****************************************************************************************************/
+    void sleepFor(const std::chrono::nanoseconds &duration) override;
+
+    /*************************************************************************//**
+     * @brief elapsed returns the virtual time passed since the clock was created.
+     * @return virtual time elapsed.
+     ****************************************************************************/
+    std::chrono::nanoseconds elapsed() const;
+
+private:
+
+    /** @brief start is the system time at which the virtual clock was created. */
+    std::chrono::system_clock::time_point start;
+
+    /** @brief elapsedTime is the virtual time (in nanoseconds) passed since `start`. */
+    std::atomic<long long> elapsedTime;
+
+    /** @brief sleeper is the id of the only thread which sleeps on the clock. */
+    std::atomic<std::thread::id> sleeper;
+};
+
+#endif // PLAYERCLOCK_H
@@ -0,0 +1,228 @@
+#include "profiledmutex.h"
+#include <set>
+#include <vector>
+#include <sstream>
+#include <iomanip>  // to use setw()
+#include <cstdio>   // for snprintf()
+
+using namespace std;
+using namespace std::chrono;
+
+/* ============= REGISTRY OF ALL THE PROFILED MUTEXES ==============*/
+/* Function local statics are used instead of static members,
+ * because static mutexes (i.e. Logger::get_instance_lock) register themselves during static initialization. */
+static mutex& registryLock(){
+    static mutex lock;
+    return lock;
+}
+
+static set<const ProfiledMutex*>& registry(){
+    static set<const ProfiledMutex*> mutexes;
+    return mutexes;
+}
+
+/* reports of the destroyed mutexes, so that reportAll() at the end of the program still shows the mutexes of the
+ * objects which are already destroyed. It is never freed, since static mutexes are destroyed after main() returns. */
+static vector<string>& retiredReports(){
+    static vector<string> *reports = new vector<string>();
+    return *reports;
+}
+
+/* call site recorded by ProfiledMutex::at(), consumed by the next lock() of the same mutex on this thread. */
+struct CallSite {
+    const ProfiledMutex *mutex = NULL;
+    unsigned short line = 0;
+    const char *function = NULL;
+};
+static thread_local CallSite nextCallSite;
+
+/* index of the power of two bucket of the duration. */
+static int bucketOf(unsigned long long nanoseconds){
+    int bucket = 0;
+    while(nanoseconds > 1 && bucket < ProfiledMutex::HISTOGRAM_BUCKETS-1){
+        nanoseconds >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static unsigned long long elapsedSince(const steady_clock::time_point &start){
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count();
+}
+
+
+/* ========== CONSTRUCTOR - DESTRUCTOR ===========*/
+ProfiledMutex::ProfiledMutex(const char *name)
+{
+    this->name = name;
+    this->holderLine = 0;
+    this->holderFunction = NULL;
+    reset();
+
+    lock_guard<mutex> lock(registryLock());
+    registry().insert(this);
+}
+
+ProfiledMutex::~ProfiledMutex(){
+    string retired;
+    if(acquisitions.load() > 0){
+        ostringstream out;
+        report(out);
+        retired = out.str();
+    }
+    lock_guard<mutex> lock(registryLock());
+    registry().erase(this);
+    if(!retired.empty())
+        retiredReports().push_back(std::move(retired));
+}
+
+
+/* ============= LOCKABLE METHODS ==============*/
+void ProfiledMutex::lock()
+{
+    // fast path: mutex is free, so there is no waiting time.
+    if(nativeMutex.try_lock()){
+        acquired(0, false);
+        return;
+    }
+    steady_clock::time_point waitingFrom = steady_clock::now();
+    nativeMutex.lock();
+    acquired(elapsedSince(waitingFrom), true);
+}
+
+bool ProfiledMutex::try_lock()
+{
+    if(!nativeMutex.try_lock())
+        return false;
+    acquired(0, false);
+    return true;
+}
+
+void ProfiledMutex::unlock()
+{
+    unsigned long long holdTime = elapsedSince(lockedAt);
+    unsigned short line = holderLine;
+    const char *function = holderFunction;
+    nativeMutex.unlock();
+
+    totalHoldTime += holdTime;
+    holdHistogram[bucketOf(holdTime)]++;
+
+    // compare without lock first, since the new longest holder is rare.
+    if(holdTime > longestHoldTime.load(memory_order_relaxed)){
+        lock_guard<std::mutex> lock(longest_holder_lock);
+        if(holdTime > longestHoldTime){
+            longestHoldTime = holdTime;
+            longestHolderLine = line;
+            longestHolderFunction = function;
+        }
+    }
+}
+
+void ProfiledMutex::acquired(const unsigned long long waitTime, const bool contended)
+{
+    lockedAt = steady_clock::now();
+
+    if(nextCallSite.mutex == this){
+        holderLine = nextCallSite.line;
+        holderFunction = nextCallSite.function;
+        nextCallSite.mutex = NULL;
+    }
+    else { // i.e. re-locked by the condition variable after waiting.
+        holderLine = 0;
+        holderFunction = NULL;
+    }
+
+    acquisitions++;
+    if(contended){
+        contentions++;
+        totalWaitTime += waitTime;
+    }
+    waitHistogram[bucketOf(waitTime)]++;
+}
+
+
+/* ============= METHODS ==============*/
+ProfiledMutex& ProfiledMutex::at(const unsigned short _line_number_, const char *_function_name_)
+{
+    nextCallSite.mutex = this;
+    nextCallSite.line = _line_number_;
+    nextCallSite.function = _function_name_;
+    return *this;
+}
+
+void ProfiledMutex::setName(const char *name){
+    this->name = name;
+}
+
+void ProfiledMutex::reset()
+{
+    acquisitions = 0;
+    contentions = 0;
+    totalWaitTime = 0;
+    totalHoldTime = 0;
+    for(int i=0; i<HISTOGRAM_BUCKETS; i++){
+        waitHistogram[i] = 0;
+        holdHistogram[i] = 0;
+    }
+    lock_guard<std::mutex> lock(longest_holder_lock);
+    longestHoldTime = 0;
+    longestHolderLine = 0;
+    longestHolderFunction = NULL;
+}
+
+/* displays the non-empty buckets of the histogram, i.e. " <1.02us:12 <4.19ms:3" */
+static void reportHistogram(ostream &out, const char *title, const atomic<unsigned long long> *histogram)
+{
+    static const char *units[] = {"ns", "us", "ms", "s"};
+    out << "    " << title << ":";
+    for(int i=0; i<ProfiledMutex::HISTOGRAM_BUCKETS; i++){
+        unsigned long long count = histogram[i].load();
+        if(count == 0) continue;
+        // bound is rounded to 3 significant digits, i.e. 65536ns is displayed as 65.5us (not truncated to 65us).
+        double upperBound = static_cast<double>(1ULL << (i+1));
+        int unit = 0;
+        while(upperBound >= 1000 && unit < 3){
+            upperBound /= 1000;
+            unit++;
+        }
+        char label[32];
+        snprintf(label, sizeof(label), " <%.3g%s:", upperBound, units[unit]);
+        out << label << count;
+    }
+    out << "\n";
+}
+
+void ProfiledMutex::report(ostream &out) const
+{
+    unsigned long long acquired = acquisitions.load();
+    unsigned long long contended = contentions.load();
+
+    out << "[" << name << "]\n"
+        << "    acquisitions : " << acquired << "\n"
+        << "    contended    : " << contended;
+    if(acquired > 0)
+        out << " (" << fixed << setprecision(1) << (100.0*contended/acquired) << "%)";
+    out << "\n"
+        << "    total wait   : " << totalWaitTime.load()/1000 << " us\n"
+        << "    total hold   : " << totalHoldTime.load()/1000 << " us\n";
+
+    reportHistogram(out, "wait histogram", waitHistogram);
+    reportHistogram(out, "hold histogram", holdHistogram);
+
+    lock_guard<std::mutex> lock(longest_holder_lock);
+    out << "    longest hold : " << longestHoldTime.load()/1000 << " us";
+    if(longestHolderFunction != NULL)
+        out << " at [" << longestHolderLine << "] -> [" << longestHolderFunction << "]";
+    out << endl;
+}
+
+void ProfiledMutex::reportAll(ostream &out)
+{
+    lock_guard<mutex> lock(registryLock());
+    out << "\n  ===== MUTEX PROFILE =====\n";
+    for(const string &retired : retiredReports())
+        out << retired;
+    for(const ProfiledMutex *profiledMutex : registry())
+        profiledMutex->report(out);
+}
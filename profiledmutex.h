@@ -0,0 +1,183 @@
+#ifndef PROFILEDMUTEX_H
+#define PROFILEDMUTEX_H
+
+#include <iostream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+
+/*********************************************************************************************************//**
+  * @def MUTEX_PROFILING
+  * @brief Compile switch of the mutex profiler.
+  *
+  * When `MUTEX_PROFILING` is defined (i.e. `DEFINES += MUTEX_PROFILING` in the `.pro` file),
+  * `PlayerMutex` is a [ProfiledMutex](@ref ProfiledMutex) and every lock acquisition is measured.\n
+  * When it is not defined, `PlayerMutex` is a plain `std::mutex`, and the macros `MUTEX_SITE()`
+  * and `MUTEX_NAME()` expand to nothing, so release builds pay nothing for the profiler.
+  ************************************************************************************************************/
+#ifdef MUTEX_PROFILING
+
+/*************************************************************************************************//**
+  * @def MUTEX_SITE(mutex)
+  * @brief records the call site (line number and function name) of the next lock of the `mutex`.
+  *
+  * It is used while constructing the lock, so that the profiler knows who is holding the mutex.\n
+  * **Example**
+  * 1. std::lock_guard<PlayerMutex> lock(MUTEX_SITE(file_lock));
+  * 2. std::unique_lock<PlayerMutex> uniqueLock(MUTEX_SITE(_lock_));
+  ************************************************************************************************/
+#define MUTEX_SITE(mutex) ((mutex).at(__LINE__, __PRETTY_FUNCTION__))
+
+/** @brief gives a readable name to the `mutex`, which is displayed in the report. */
+#define MUTEX_NAME(mutex, name) ((mutex).setName(name))
+
+class ProfiledMutex;
+/** @brief PlayerMutex is the mutex type used by the player and the logger. */
+typedef ProfiledMutex PlayerMutex;
+/** @brief PlayerConditionVariable is the condition variable that can wait on a `PlayerMutex`. */
+typedef std::condition_variable_any PlayerConditionVariable;
+
+#else
+
+#define MUTEX_SITE(mutex) (mutex)
+#define MUTEX_NAME(mutex, name) ((void)0)
+
+typedef std::mutex PlayerMutex;
+typedef std::condition_variable PlayerConditionVariable;
+
+#endif // MUTEX_PROFILING
+
+
+/***********************************************************************************************************//**
+ * @class ProfiledMutex
+ * @brief ProfiledMutex is a drop-in replacement of `std::mutex` which profiles the lock usage.
+ *
+ * It satisfies the *Lockable* requirements, so it can be used with `std::lock_guard`, `std::unique_lock`
+ * and `std::condition_variable_any`.\n
+ * For every mutex it records
+ * 1. number of acquisitions
+ * 2. number of contended acquisitions (the mutex was already held by someone else)
+ * 3. histogram of the time spent waiting for the mutex
+ * 4. histogram of the time the mutex was held
+ * 5. call site (line and function) of the longest holder
+ * .
+ * Histograms use power of two buckets of nanoseconds, bucket `i` counts durations in range [2^i, 2^(i+1)).\n
+ * Every ProfiledMutex registers itself into a global registry, so `ProfiledMutex::reportAll()`
+ * can display the statistics of all the mutexes at once, including the mutexes destroyed before it is called.
+ **************************************************************************************************************/
+class ProfiledMutex
+{
+public:
+
+    /** @brief total number of buckets in the wait-time and hold-time histograms. */
+    static const int HISTOGRAM_BUCKETS = 40;
+
+    /*************************************************************//**
+     * @brief ProfiledMutex constructor registers the mutex in the registry.
+     * @param name is the name of the mutex displayed in the report.
+     ****************************************************************/
+    ProfiledMutex(const char *name = "unnamed");
+
+    /** @brief ~ProfiledMutex removes the mutex from the registry, and keeps its report if it was ever locked. */
+    ~ProfiledMutex();
+
+    ProfiledMutex(const ProfiledMutex &) = delete;
+    ProfiledMutex& operator= (const ProfiledMutex &) = delete;
+
+    /** @brief locks the mutex and measures the waiting time, if the mutex is contended. */
+    void lock();
+
+    /*************************************************************//**
+     * @brief tries to lock the mutex without waiting.
+     * @return true if the mutex is locked, else false.
+     ****************************************************************/
+    bool try_lock();
+
+    /** @brief unlocks the mutex and records the time for which the mutex was held. */
+    void unlock();
+
+    /*****************************************************************************************//**
+     * @brief records the call site which is going to lock the mutex next (used by `MUTEX_SITE()`).
+     * @param _line_number_ is the line on which the lock is taken.
+     * @param _function_name_ is the function in which the lock is taken.
+     * @return reference of this mutex, so that it can be passed directly to the lock.
+     ********************************************************************************************/
+    ProfiledMutex& at(const unsigned short _line_number_, const char *_function_name_);
+
+    /** @brief sets the name of the mutex displayed in the report. */
+    void setName(const char *name);
+
+    /** @brief resets all the counters and histograms of the mutex. */
+    void reset();
+
+    /*****************************************************//**
+     * @brief displays the statistics of this mutex.
+     * @param out is the stream in which report is written.
+     ********************************************************/
+    void report(std::ostream &out) const;
+
+    /*******************************************************************//**
+     * @brief displays the statistics of all the profiled mutexes, the destroyed ones first.
+     * @param out is the stream in which report is written (default `std::cout`).
+     **********************************************************************/
+    static void reportAll(std::ostream &out = std::cout);
+
+private:
+
+    /** @brief nativeMutex is the actual mutex being profiled. */
+    std::mutex nativeMutex;
+
+    /** @brief name of the mutex, displayed in the report. */
+    const char *name;
+
+    /** @brief total number of the acquisitions of the mutex. */
+    std::atomic<unsigned long long> acquisitions;
+
+    /** @brief number of acquisitions, in which the mutex was already locked by another thread. */
+    std::atomic<unsigned long long> contentions;
+
+    /** @brief sum of all the waiting times in nanoseconds. */
+    std::atomic<unsigned long long> totalWaitTime;
+
+    /** @brief sum of all the holding times in nanoseconds. */
+    std::atomic<unsigned long long> totalHoldTime;
+
+    /** @brief waitHistogram counts the waiting times in power of two buckets of nanoseconds. */
+    std::atomic<unsigned long long> waitHistogram[HISTOGRAM_BUCKETS];
+
+    /** @brief holdHistogram counts the holding times in power of two buckets of nanoseconds. */
+    std::atomic<unsigned long long> holdHistogram[HISTOGRAM_BUCKETS];
+
+    /** @brief longest time (in nanoseconds) for which the mutex was held. */
+    std::atomic<unsigned long long> longestHoldTime;
+
+    /** @brief line number of the longest holder. */
+    unsigned short longestHolderLine;
+
+    /** @brief function name of the longest holder. */
+    const char *longestHolderFunction;
+
+    /** @brief longest_holder_lock protects the call site of the longest holder. */
+    mutable std::mutex longest_holder_lock;
+
+    /*
+     * Below members are written only by the thread which is holding the mutex,
+     * so they don't need any extra synchronization.
+     */
+
+    /** @brief time at which the current holder has locked the mutex. */
+    std::chrono::steady_clock::time_point lockedAt;
+
+    /** @brief line number of the current holder. */
+    unsigned short holderLine;
+
+    /** @brief function name of the current holder. */
+    const char *holderFunction;
+
+    /** @brief called after the mutex is locked, to store the holder's details. */
+    void acquired(const unsigned long long waitTime, const bool contended);
+};
+
+#endif // PROFILEDMUTEX_H
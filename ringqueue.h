@@ -0,0 +1,98 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <vector>
+#include <optional>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+
+/*******************************************************************************************************//**
+ * @class RingQueue
+ * @brief RingQueue is a FIFO queue stored in a growable ring buffer, with the interface of `std::queue`.
+ * @tparam T is the type of the elements.
+ *
+ * Unlike `std::deque`, which allocates and frees a node every few elements while the queue moves forward,
+ * the ring buffer is allocated only when it grows, and its capacity is kept when the elements are popped.\n
+ * So once the queue has reached its largest size (or after `reserve()`), pushing and popping never allocate.\n
+ * It is not thread safe, the owner must serialize the calls.
+ **********************************************************************************************************/
+template <typename T>
+class RingQueue
+{
+public:
+
+    /** @brief RingQueue constructs an empty queue, without allocating. */
+    RingQueue() : head(0), count(0) {}
+
+    /** @brief reserve makes space for `capacity` elements, so that they can be pushed without allocating. */
+    void reserve(const size_t capacity){
+        if(capacity > slots.size())
+            grow(capacity);
+    }
+
+    /** @brief push copies the element at the end of the queue. */
+    void push(const T &element){ emplace(element); }
+
+    /** @brief push moves the element at the end of the queue. */
+    void push(T &&element){ emplace(std::move(element)); }
+
+    /*************************************************************************************************//**
+     * @brief emplace constructs the element at the end of the queue.
+     * @param arguments are passed to the constructor of `T`, they must not refer to the elements of the queue.
+     ****************************************************************************************************/
+    template <typename... Arguments>
+    void emplace(Arguments&&... arguments)
+    {
+        if(count == slots.size())
+            grow(std::max<size_t>(16, 2*slots.size()));
+        slots[(head+count) % slots.size()].emplace(std::forward<Arguments>(arguments)...);
+        count++;
+    }
+
+    /** @brief pop destroys the first element, the queue must not be empty. */
+    void pop(){
+        slots[head].reset();
+        head = (head+1) % slots.size();
+        count--;
+    }
+
+    /** @brief returns the first element, the queue must not be empty. */
+    T& front(){ return *slots[head]; }
+
+    /** @brief returns the last element, the queue must not be empty. */
+    T& back(){ return *slots[(head+count-1) % slots.size()]; }
+
+    /** @brief returns the number of the elements. */
+    size_t size() const { return count; }
+
+    /** @brief returns true if the queue has no element. */
+    bool empty() const { return count == 0; }
+
+    /** @brief returns the number of the elements which can be stored without allocating. */
+    size_t capacity() const { return slots.size(); }
+
+private:
+
+    /** @brief grow moves the elements, in order, into a new ring buffer of `capacity` slots. */
+    void grow(const size_t capacity)
+    {
+        std::vector<std::optional<T>> larger(capacity);
+        for(size_t i=0; i<count; i++)
+            larger[i] = std::move(slots[(head+i) % slots.size()]);
+        slots.swap(larger);
+        head = 0;
+    }
+
+    /** @brief slots is the ring buffer, an empty slot holds no element. */
+    std::vector<std::optional<T>> slots;
+
+    /** @brief head is the index of the first element. */
+    size_t head;
+
+    /** @brief count is the number of the elements. */
+    size_t count;
+};
+
+#endif // RINGQUEUE_H
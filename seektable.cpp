@@ -0,0 +1,384 @@
+#include "seektable.h"
+#include "logger.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <strings.h>   // for strncasecmp()
+#include <fcntl.h>     // for open()
+#include <unistd.h>    // for close()
+#include <sys/mman.h>  // for mmap()
+#include <sys/stat.h>  // for stat(), mkdir()
+
+using namespace std;
+using namespace std::chrono;
+
+/* magic string at the beginning of the table file, change the version if the format changes. */
+static const char TABLE_MAGIC[8] = {'S','E','E','K','T','B','0','1'};
+
+constexpr milliseconds SeekTable::DEFAULT_INTERVAL;
+
+
+/* ============= MPEG AUDIO FRAME HEADERS ==============*/
+/* details of an MPEG audio frame, parsed from its 4 bytes header. */
+struct FrameHeader {
+    unsigned int length;          // bytes of the frame including header
+    unsigned int sampleRate;
+    unsigned int samplesPerFrame;
+};
+
+/* kbps of the bitrate index, for [MPEG-1 layer I, II, III, MPEG-2/2.5 layer I, layer II & III] */
+static const unsigned short BITRATES[5][16] = {
+    {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+    {0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+    {0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 0},
+    {0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+    {0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0}
+};
+
+/* sample rates of MPEG-1, the rate is halved for MPEG-2 and quartered for MPEG-2.5 */
+static const unsigned int SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+static bool parseFrameHeader(const unsigned char *header, FrameHeader &frame)
+{
+    if(header[0] != 0xFF || (header[1] & 0xE0) != 0xE0)
+        return false;
+
+    int version = (header[1] >> 3) & 3;   // 3: MPEG-1, 2: MPEG-2, 0: MPEG-2.5
+    int layer = 4 - ((header[1] >> 1) & 3); // 1, 2 or 3 (4 is reserved)
+    int bitrateIndex = header[2] >> 4;
+    int sampleRateIndex = (header[2] >> 2) & 3;
+    int padding = (header[2] >> 1) & 1;
+    if(version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3)
+        return false; // reserved values, or free format which can not be scanned by length
+
+    bool mpeg1 = version == 3;
+    int table = mpeg1 ? layer-1 : (layer == 1 ? 3 : 4);
+    unsigned int bitrate = BITRATES[table][bitrateIndex] * 1000;
+    frame.sampleRate = SAMPLE_RATES[sampleRateIndex] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+
+    if(layer == 1){
+        frame.samplesPerFrame = 384;
+        frame.length = (12 * bitrate / frame.sampleRate + padding) * 4;
+    }
+    else {
+        frame.samplesPerFrame = (layer == 3 && !mpeg1) ? 576 : 1152;
+        frame.length = frame.samplesPerFrame / 8 * bitrate / frame.sampleRate + padding;
+    }
+    return frame.length > 4;
+}
+
+/* size of the ID3v2 tag at the beginning of the file, which is skipped before the first frame. */
+static size_t id3TagSize(const unsigned char *data, const size_t size)
+{
+    if(size < 10 || memcmp(data, "ID3", 3) != 0)
+        return 0;
+    size_t tagSize = ((data[6] & 0x7F) << 21) | ((data[7] & 0x7F) << 14) | ((data[8] & 0x7F) << 7) | (data[9] & 0x7F);
+    bool footer = data[5] & 0x10;
+    return 10 + tagSize + (footer ? 10 : 0);
+}
+
+
+/* ============= SEEK TABLE ==============*/
+bool SeekTable::isMpegAudio(string_view filename)
+{
+    static const char *EXTENSIONS[] = {"mp3", "mp2", "mp1", "mpga"};
+    size_t dot = filename.rfind('.');
+    if(dot == string_view::npos || filename.find('/', dot) != string_view::npos)
+        return false;
+    string_view extension = filename.substr(dot + 1);
+    for(const char *known : EXTENSIONS){
+        if(extension.size() == strlen(known) && strncasecmp(extension.data(), known, extension.size()) == 0)
+            return true;
+    }
+    return false;
+}
+
+SeekTable SeekTable::build(const string &filename, const milliseconds &interval)
+{
+    if(!isMpegAudio(filename))
+        throw runtime_error("Not an MPEG audio file '" + filename + "'");
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw runtime_error("Failed to open audio file '" + filename + "'");
+
+    struct stat status;
+    if(fstat(fd, &status) != 0 || status.st_size == 0){
+        close(fd);
+        throw runtime_error("Failed to read audio file '" + filename + "'");
+    }
+    size_t size = status.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        throw runtime_error("Failed to map audio file '" + filename + "'");
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const unsigned char *data = static_cast<const unsigned char*>(mapped);
+
+    SeekTable table;
+    table.interval = duration_cast<microseconds>(interval).count();
+    table.duration = 0;
+    table.sampleRate = 0;
+    table.samplesPerFrame = 0;
+    table.fileSize = size;
+    table.fileModified = status.st_mtime;
+
+    unsigned long long frameIndex = 0, samples = 0;
+    size_t offset = id3TagSize(data, size);
+    size_t syncLimit = offset + MAX_SYNC_SEARCH; // i.e. a WAV file renamed to mp3 is not scanned till its end
+    while(offset + 4 <= size && (table.sampleRate != 0 || offset < syncLimit))
+    {
+        FrameHeader frame;
+        if(!parseFrameHeader(data + offset, frame) || (table.sampleRate != 0 && frame.sampleRate != table.sampleRate)){
+            offset++; // garbage between the frames, search for the next sync word
+            continue;
+        }
+        if(table.sampleRate == 0){
+            // lock on the stream only if the next frame is also valid, to avoid false sync words.
+            FrameHeader next;
+            if(offset + frame.length + 4 <= size && !parseFrameHeader(data + offset + frame.length, next)){
+                offset++;
+                continue;
+            }
+            table.sampleRate = frame.sampleRate;
+            table.samplesPerFrame = frame.samplesPerFrame;
+        }
+        if(offset + frame.length > size) // truncated last frame
+            break;
+
+        // add entries for all the interval points covered by this frame.
+        long long start = samples * 1000000 / table.sampleRate;
+        long long end = (samples + frame.samplesPerFrame) * 1000000 / table.sampleRate;
+        while(static_cast<long long>(table.entries.size()) * table.interval < end)
+            table.entries.push_back({offset, frameIndex, start});
+
+        samples += frame.samplesPerFrame;
+        offset += frame.length;
+        frameIndex++;
+    }
+    munmap(mapped, size);
+
+    if(table.entries.empty())
+        throw runtime_error("No MPEG audio frames found in '" + filename + "'");
+    table.duration = samples * 1000000 / table.sampleRate;
+    return table;
+}
+
+SeekTable::Entry SeekTable::lookup(const microseconds &position) const
+{
+    long long index = position.count() / interval;
+    if(index < 0) index = 0;
+    if(index >= static_cast<long long>(entries.size())) index = entries.size()-1;
+    return entries[index];
+}
+
+microseconds SeekTable::getDuration() const { return microseconds(duration); }
+unsigned int SeekTable::getSampleRate() const { return sampleRate; }
+unsigned int SeekTable::getSamplesPerFrame() const { return samplesPerFrame; }
+size_t SeekTable::size() const { return entries.size(); }
+
+bool SeekTable::matches(const string &audioFilename) const
+{
+    struct stat status;
+    return stat(audioFilename.c_str(), &status) == 0
+        && static_cast<unsigned long long>(status.st_size) == fileSize
+        && static_cast<long long>(status.st_mtime) == fileModified;
+}
+
+bool SeekTable::save(const string &filename) const
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(file == NULL)
+        return false;
+
+    unsigned long long totalEntries = entries.size();
+    bool written = fwrite(TABLE_MAGIC, sizeof(TABLE_MAGIC), 1, file) == 1
+                && fwrite(&interval, sizeof(interval), 1, file) == 1
+                && fwrite(&duration, sizeof(duration), 1, file) == 1
+                && fwrite(&sampleRate, sizeof(sampleRate), 1, file) == 1
+                && fwrite(&samplesPerFrame, sizeof(samplesPerFrame), 1, file) == 1
+                && fwrite(&fileSize, sizeof(fileSize), 1, file) == 1
+                && fwrite(&fileModified, sizeof(fileModified), 1, file) == 1
+                && fwrite(&totalEntries, sizeof(totalEntries), 1, file) == 1
+                && fwrite(entries.data(), sizeof(Entry), totalEntries, file) == totalEntries;
+    return fclose(file) == 0 && written;
+}
+
+bool SeekTable::load(const string &filename, SeekTable &table)
+{
+    FILE *file = fopen(filename.c_str(), "rb");
+    if(file == NULL)
+        return false;
+
+    char magic[sizeof(TABLE_MAGIC)];
+    unsigned long long totalEntries = 0;
+    bool valid = fread(magic, sizeof(magic), 1, file) == 1
+              && memcmp(magic, TABLE_MAGIC, sizeof(magic)) == 0
+              && fread(&table.interval, sizeof(table.interval), 1, file) == 1
+              && fread(&table.duration, sizeof(table.duration), 1, file) == 1
+              && fread(&table.sampleRate, sizeof(table.sampleRate), 1, file) == 1
+              && fread(&table.samplesPerFrame, sizeof(table.samplesPerFrame), 1, file) == 1
+              && fread(&table.fileSize, sizeof(table.fileSize), 1, file) == 1
+              && fread(&table.fileModified, sizeof(table.fileModified), 1, file) == 1
+              && fread(&totalEntries, sizeof(totalEntries), 1, file) == 1
+              && table.interval > 0 && totalEntries > 0 && totalEntries <= table.fileSize;
+    if(valid){
+        table.entries.resize(totalEntries);
+        valid = fread(table.entries.data(), sizeof(Entry), totalEntries, file) == totalEntries;
+    }
+    fclose(file);
+    return valid;
+}
+
+
+/* ============= SEEK TABLE CACHE ==============*/
+SeekTableCache::SeekTableCache(){
+    directory = "seektables";
+    MUTEX_NAME(cache_lock, "SeekTableCache::cache_lock");
+}
+
+SeekTableCache* SeekTableCache::get(){
+    static SeekTableCache cache;
+    return &cache;
+}
+
+void SeekTableCache::setDirectory(const string &directory){
+    lock_guard<PlayerMutex> lock(MUTEX_SITE(cache_lock));
+    this->directory = directory;
+}
+
+string SeekTableCache::tableFilename(string_view audioPath) const
+{
+    // name of the table is the FNV-1a hash of the audio path, since the path may contain '/'.
+    unsigned long long hash = 14695981039346656037ULL;
+    for(char character : audioPath){
+        hash ^= static_cast<unsigned char>(character);
+        hash *= 1099511628211ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.seek", hash);
+    return directory + name;
+}
+
+shared_ptr<const SeekTable> SeekTableCache::find(const Song &song)
+{
+    string_view audioPath = song.getAudioPath();
+    string tablePath;
+    {
+        lock_guard<PlayerMutex> lock(MUTEX_SITE(cache_lock));
+        auto found = tables.find(audioPath);
+        if(found != tables.end())
+            return found->second;
+        tablePath = tableFilename(audioPath);
+    }
+
+    // table is loaded or built without the lock, since scanning a long file takes time.
+    string audioFilename(audioPath);
+    shared_ptr<SeekTable> table = make_shared<SeekTable>();
+    try {
+        if(!SeekTable::load(tablePath, *table) || !table->matches(audioFilename)){
+            *table = SeekTable::build(audioFilename);
+            string tableDirectory = tablePath.substr(0, tablePath.rfind('/'));
+            mkdir(tableDirectory.c_str(), 0755);
+            table->save(tablePath); // table is only a cache, so failing to save it is not an error
+        }
+    } catch (const exception &e) {
+        LOG(warning, e.what());
+        table.reset(); // failure is cached too, so the file is not scanned again
+    }
+
+    lock_guard<PlayerMutex> lock(MUTEX_SITE(cache_lock));
+    return tables.emplace(std::move(audioFilename), table).first->second; // key is owned, the song may be freed
+}
+
+void SeekTableCache::prepare(const Song &song)
+{
+    // other audio files (i.e. WAV) have no frames to index, they are not even opened.
+    if(SeekTable::isMpegAudio(song.getAudioPath()))
+        find(song);
+}
+
+
+/* ============= MPEG FILE SOURCE ==============*/
+MpegFileSource::MpegFileSource(const string &filename, shared_ptr<const SeekTable> table)
+{
+    if(table == nullptr)
+        throw runtime_error("No seek table of audio file '" + filename + "'");
+    this->table = std::move(table);
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw runtime_error("Failed to open audio file '" + filename + "'");
+    struct stat status;
+    if(fstat(fd, &status) != 0 || status.st_size == 0){
+        close(fd);
+        throw runtime_error("Failed to read audio file '" + filename + "'");
+    }
+    size = status.st_size;
+    // pages are read now (and locked, best effort), so the render thread does not wait for the disk.
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        throw runtime_error("Failed to map audio file '" + filename + "'");
+    mlock(mapped, size);
+    data = static_cast<const unsigned char*>(mapped);
+
+    // duration of the table is truncated to microseconds, so rounding it up gives back the samples.
+    unsigned long long rate = this->table->getSampleRate();
+    totalFrames = (static_cast<unsigned long long>(this->table->getDuration().count()) * rate + 999999) / 1000000;
+    seek(0);
+}
+
+MpegFileSource::~MpegFileSource(){
+    munlock(data, size);
+    munmap(const_cast<unsigned char*>(data), size);
+}
+
+bool MpegFileSource::nextAudioFrame()
+{
+    // frames are followed as build() found them, so the index of the frame matches the table.
+    FrameHeader frame;
+    size_t next = offset + 1;
+    if(offset + 4 <= size && parseFrameHeader(data + offset, frame) && frame.sampleRate == table->getSampleRate())
+        next = offset + frame.length;
+    for(; next + 4 <= size; next++){
+        if(parseFrameHeader(data + next, frame) && frame.sampleRate == table->getSampleRate()){
+            if(next + frame.length > size) // truncated last frame
+                return false;
+            offset = next;
+            audioFrame++;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t MpegFileSource::read(float *buffer, const size_t frames, const unsigned int channels)
+{
+    unsigned int samplesPerFrame = table->getSamplesPerFrame();
+    size_t count = 0;
+    for(; count < frames && position < totalFrames; count++, position++){
+        if(position / samplesPerFrame > audioFrame && !nextAudioFrame()){
+            position = totalFrames; // file is shorter than its table, i.e. truncated after the table was built
+            break;
+        }
+        for(unsigned int channel=0; channel<channels; channel++)
+            buffer[count*channels + channel] = 0.0f; // silence, there is no decoder yet
+    }
+    return count;
+}
+
+void MpegFileSource::seek(const unsigned long long frame)
+{
+    position = frame < totalFrames ? frame : totalFrames;
+    SeekTable::Entry entry = table->lookup(microseconds(position * 1000000 / table->getSampleRate()));
+    offset = entry.offset;
+    audioFrame = entry.frame;
+
+    // entry is at most one interval before the position, so only a few frames are skipped.
+    unsigned long long target = position / table->getSamplesPerFrame();
+    while(audioFrame < target && nextAudioFrame()){}
+}
+
+unsigned long long MpegFileSource::getOffset() const { return offset; }
+unsigned long long MpegFileSource::getAudioFrame() const { return audioFrame; }
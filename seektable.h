@@ -0,0 +1,237 @@
+#ifndef SEEKTABLE_H
+#define SEEKTABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <map>
+#include "song.h"
+#include "profiledmutex.h"
+#include "audiorenderer.h"
+
+
+/**********************************************************************************************************//**
+ * @class SeekTable
+ * @brief SeekTable maps the time of an MPEG audio file (i.e. mp3) to the byte offset of its frame.
+ *
+ * MPEG audio files (specially VBR) can not be seeked by arithmetic, since every frame has its own size.\n
+ * SeekTable scans the frame headers once, and stores one entry for every `interval` of the song.\n
+ * So seeking to any position is a single array lookup, followed by skipping at most one interval of frames,
+ * regardless of the length of the file.
+ *************************************************************************************************************/
+class SeekTable
+{
+public:
+
+    /** @brief Entry is the position of an audio frame in the file. */
+    struct Entry {
+        /** @brief byte offset of the frame in the file. */
+        unsigned long long offset;
+        /** @brief index of the audio frame. */
+        unsigned long long frame;
+        /** @brief start time (in microseconds) of the frame. */
+        long long time;
+    };
+
+    /** @brief default time between two entries of the table. */
+    static constexpr std::chrono::milliseconds DEFAULT_INTERVAL{1000};
+
+    /** @brief first frame must be found within this many bytes after the ID3 tag, else the file is not MPEG audio. */
+    static const size_t MAX_SYNC_SEARCH = 64 * 1024;
+
+    /** @brief isMpegAudio tells whether the file is an MPEG audio file by its extension (mp3, mp2, mp1, mpga). */
+    static bool isMpegAudio(std::string_view filename);
+
+    /*************************************************************************************************//**
+     * @brief build scans the frame headers of the MPEG audio file and creates its seek table.
+     *
+     * Other files are refused before they are read: by the extension, then by the first two frame headers,
+     * which must follow each other within `MAX_SYNC_SEARCH` bytes after the ID3 tag.
+     * @param filename is the path of the audio file.
+     * @param interval is the time between two entries of the table (default `DEFAULT_INTERVAL`).
+     * @return the seek table, it throws `std::runtime_error` if the file can not be read or is not MPEG audio.
+     ****************************************************************************************************/
+    static SeekTable build(const std::string &filename,
+                           const std::chrono::milliseconds &interval = DEFAULT_INTERVAL);
+
+    /*************************************************************************//**
+     * @brief lookup returns the last entry at or before the position, in O(1).
+     * @param position is the time to seek.
+     * @return entry from which the decoder should start decoding.
+     ****************************************************************************/
+    Entry lookup(const std::chrono::microseconds &position) const;
+
+    /** @brief duration of the audio file. */
+    std::chrono::microseconds getDuration() const;
+
+    /** @brief sample rate of the audio file. */
+    unsigned int getSampleRate() const;
+
+    /** @brief number of samples (per channel) in one audio frame. */
+    unsigned int getSamplesPerFrame() const;
+
+    /** @brief number of entries of the table. */
+    size_t size() const;
+
+    /*******************************************************************************************//**
+     * @brief save writes the table into the file, along with size and modification time of the audio file.
+     * @param filename is the path of the table file.
+     * @return false if the file can not be written.
+     **********************************************************************************************/
+    bool save(const std::string &filename) const;
+
+    /*******************************************************************************************//**
+     * @brief load reads the table from the file.
+     * @param filename is the path of the table file.
+     * @param table is filled with the table read from the file.
+     * @return false if the file does not exist or is invalid.
+     **********************************************************************************************/
+    static bool load(const std::string &filename, SeekTable &table);
+
+    /** @brief checks whether the audio file is same (size and modification time) as it was while building the table. */
+    bool matches(const std::string &audioFilename) const;
+
+private:
+
+    /** @brief interval (in microseconds) between two entries. */
+    long long interval;
+
+    /** @brief duration (in microseconds) of the audio file. */
+    long long duration;
+
+    /** @brief sample rate of the audio file. */
+    unsigned int sampleRate;
+
+    /** @brief number of samples (per channel) in one frame. */
+    unsigned int samplesPerFrame;
+
+    /** @brief size of the audio file while building the table. */
+    unsigned long long fileSize;
+
+    /** @brief modification time of the audio file while building the table. */
+    long long fileModified;
+
+    /** @brief entries[i] is the frame which contains the time `i * interval`. */
+    std::vector<Entry> entries;
+};
+
+
+/**********************************************************************************************************//**
+ * @class SeekTableCache
+ * @brief SeekTableCache keeps the seek tables of the songs in memory and on disk.
+ *
+ * It is a singleton like the [Logger](@ref Logger).\n
+ * Tables are built when a song is queued into the playlist (`prepare()`), never on the player path,
+ * and are saved into the cache directory (default `seektables/`), next to the other library data.\n
+ * A file whose table can not be built is remembered, so it is not scanned (and logged) again.\n
+ * A saved table is used again only if the size and modification time of the audio file are unchanged.
+ *************************************************************************************************************/
+class SeekTableCache
+{
+public:
+
+    /** @brief returns the singleton instance of the cache. */
+    static SeekTableCache* get();
+
+    /** @brief sets the directory in which the tables are saved. */
+    void setDirectory(const std::string &directory);
+
+    /******************************************************************************************************//**
+     * @brief find returns the seek table of the song, loading or building it if it is not in memory.
+     * @param song whose table is needed, its `getAudioPath()` must not be empty.
+     * @return shared pointer to the table, empty if the table can not be built (the failure is logged once).
+     *********************************************************************************************************/
+    std::shared_ptr<const SeekTable> find(const Song &song);
+
+    /** @brief prepare builds (or loads) the table of the song, if it has the path of an MPEG audio file. */
+    void prepare(const Song &song);
+
+private:
+
+    /** @brief private constructor of the singleton. */
+    SeekTableCache();
+
+    SeekTableCache(const SeekTableCache &) = delete;
+    SeekTableCache& operator= (const SeekTableCache &) = delete;
+
+    /** @brief path of the table file of the audio file. */
+    std::string tableFilename(std::string_view audioPath) const;
+
+    /** @brief directory in which the tables are saved. */
+    std::string directory;
+
+    /** @brief tables maps the audio path of the songs to their tables, empty for the files which failed. */
+    std::map<std::string, std::shared_ptr<const SeekTable>, std::less<>> tables;
+
+    /** @brief cache_lock protects `directory` and `tables`. */
+    PlayerMutex cache_lock;
+};
+
+
+
+/**********************************************************************************************************//**
+ * @class MpegFileSource
+ * @brief MpegFileSource is an [AudioSource](@ref AudioSource) which follows the frames of an MPEG audio file.
+ *
+ * File is mapped into the memory by the constructor, so the render thread never reads the disk through a system call.\n
+ * seek() takes the entry of the [SeekTable](@ref SeekTable) and skips the frames to the target, at most one interval,
+ * so the SEEK command of the [AudioRenderer](@ref AudioRenderer) costs the same at any position of any file.\n
+ * There is no decoder yet, so read() renders silence while it walks the frames at the sample rate of the file
+ * (frames of the renderer are taken as the samples of the file, there is no resampling).
+ *************************************************************************************************************/
+class MpegFileSource : public AudioSource
+{
+public:
+
+    /*************************************************************************************************//**
+     * @brief MpegFileSource constructor, it throws `std::runtime_error` if the file can not be mapped.
+     * @param filename is the path of the audio file.
+     * @param table is the seek table of the file, see SeekTableCache::find().
+     ****************************************************************************************************/
+    MpegFileSource(const std::string &filename, std::shared_ptr<const SeekTable> table);
+
+    /** @brief ~MpegFileSource unmaps the file. */
+    ~MpegFileSource();
+
+    MpegFileSource(const MpegFileSource &) = delete;
+    MpegFileSource& operator= (const MpegFileSource &) = delete;
+
+    size_t read(float *buffer, const size_t frames, const unsigned int channels) override;
+    void seek(const unsigned long long frame) override;
+
+    /** @brief byte offset of the audio frame at the read position. */
+    unsigned long long getOffset() const;
+
+    /** @brief index of the audio frame at the read position. */
+    unsigned long long getAudioFrame() const;
+
+private:
+
+    /** @brief moves `offset` to the next audio frame, returns false at the end of the file. */
+    bool nextAudioFrame();
+
+    /** @brief table of the file, shared with the cache. */
+    std::shared_ptr<const SeekTable> table;
+
+    /** @brief mapped file. */
+    const unsigned char *data;
+
+    /** @brief size of the file. */
+    size_t size;
+
+    /** @brief totalFrames is the length of the file in samples (per channel). */
+    unsigned long long totalFrames;
+
+    /** @brief position is the next sample (per channel) to render. */
+    unsigned long long position;
+
+    /** @brief byte offset of the audio frame which contains `position`. */
+    unsigned long long offset;
+
+    /** @brief index of the audio frame which contains `position`. */
+    unsigned long long audioFrame;
+};
+
+#endif // SEEKTABLE_H
@@ -0,0 +1,217 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include "seektable.h"
+#include "audiorenderer.h"
+#include "logger.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/* length of the generated MPEG-1 layer III file, about 10 minutes at 44.1 kHz. */
+static const size_t TOTAL_AUDIO_FRAMES = 23000;
+static const unsigned int SAMPLES_PER_FRAME = 1152;
+static const unsigned int SAMPLE_RATE = 44100;
+
+/* kbps of the MPEG-1 layer III bitrate indexes 1..14. */
+static const unsigned short BITRATES[15] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+
+/*****************************************************************************************************//**
+ * @brief writes a VBR MPEG-1 layer III file, with an ID3v2 tag and some garbage between the frames.
+ * @param filename of the file.
+ * @param offsets is filled with the byte offset of every audio frame.
+ ********************************************************************************************************/
+static void writeMpegFile(const string &filename, vector<unsigned long long> &offsets)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(file == NULL)
+        throw runtime_error("Failed to create '" + filename + "'");
+
+    // ID3v2.4 tag of 4000 bytes (synchsafe size), whose content is never parsed.
+    unsigned char tag[10 + 4000] = {'I', 'D', '3', 4, 0, 0, 0, 0, 4000 >> 7, 4000 & 0x7F};
+    fwrite(tag, sizeof(tag), 1, file);
+    unsigned long long offset = sizeof(tag);
+
+    // frames are zero filled, so no false sync word is found in them.
+    vector<unsigned char> frame(2000, 0);
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    offsets.clear();
+    for(size_t i=0; i<TOTAL_AUDIO_FRAMES; i++){
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        if(random % 50 == 0){ // a few bytes of garbage, which the scanner skips
+            unsigned char garbage[3] = {0, 0, 0};
+            fwrite(garbage, sizeof(garbage), 1, file);
+            offset += sizeof(garbage);
+        }
+        int bitrateIndex = 1 + random % 14;
+        int padding = (random >> 8) & 1;
+        size_t length = 144 * BITRATES[bitrateIndex] * 1000 / SAMPLE_RATE + padding;
+        frame[0] = 0xFF;
+        frame[1] = 0xFB; // MPEG-1, layer III, no CRC
+        frame[2] = static_cast<unsigned char>(bitrateIndex << 4 | padding << 1); // 44.1 kHz
+        frame[3] = 0xC4; // mono
+        fwrite(frame.data(), length, 1, file);
+        offsets.push_back(offset);
+        offset += length;
+    }
+    fclose(file);
+}
+
+/* writes a WAV file of silence, to check that it is refused. */
+static void writeWavFile(const string &filename)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(file == NULL)
+        throw runtime_error("Failed to create '" + filename + "'");
+    const unsigned char header[12] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E'};
+    fwrite(header, sizeof(header), 1, file);
+    vector<unsigned char> samples(1024 * 1024, 0);
+    fwrite(samples.data(), samples.size(), 1, file);
+    fclose(file);
+}
+
+/* returns true if build() throws for the file. */
+static bool refused(const string &filename)
+{
+    try {
+        SeekTable::build(filename);
+        return false;
+    } catch (const exception &) {
+        return true;
+    }
+}
+
+/* displays the result of a check. */
+static bool check(const char *name, const bool passed)
+{
+    printf("%-42s %s\n", name, passed ? "PASS" : "FAIL");
+    return passed;
+}
+
+/* displays the percentiles of the latencies (in nanoseconds). */
+static void reportLatency(const char *name, vector<double> &latencies)
+{
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p){ return latencies[static_cast<size_t>(p * (latencies.size() - 1))] / 1000; };
+    printf("%s p50 %.2f, p99 %.2f, max %.2f us\n", name, percentile(0.5), percentile(0.99), latencies.back() / 1000);
+}
+
+/*****************************************************************************************************//**
+ * @brief main method of the seektest, which checks the seek tables and the seek of the file source.
+ *
+ * A VBR MPEG file of about 10 minutes is generated, with an ID3v2 tag and garbage between some frames,
+ * so the byte offset of every frame is known.\n
+ * Checks:
+ * 1. non-MPEG files (by the extension, and a WAV file renamed to mp3) are refused by SeekTable::build().
+ * 2. the table has the duration of the generated file.
+ * 3. random seeks of an [MpegFileSource](@ref MpegFileSource) land on the frame of the position,
+ *    and reading on from there follows the frames.
+ * 4. seeks sent through the SEEK command of an [AudioRenderer](@ref AudioRenderer) reach the source.
+ * .
+ * Latencies of the seeks are displayed, they must not depend on the position.
+ * @return 0 if all the checks pass, else returns 1.
+ ********************************************************************************************************/
+int main()
+{
+    const size_t totalSeeks = 100000;
+    Logger::get()->disableConsoleOutput();
+    Logger::get()->setFilename("seektest.log");
+
+    bool passed = true;
+    try {
+        vector<unsigned long long> offsets;
+        writeMpegFile("seektest.mp3", offsets);
+        writeWavFile("seektest.wav");
+        rename("seektest.wav", "seektest_wav.mp3");
+        writeWavFile("seektest.wav");
+
+        passed &= check("isMpegAudio", SeekTable::isMpegAudio("a/b.mp3") && SeekTable::isMpegAudio("B.MP2")
+                                     && !SeekTable::isMpegAudio("a.mp3/b.wav") && !SeekTable::isMpegAudio("mp3"));
+        passed &= check("build refuses WAV", refused("seektest.wav"));
+        passed &= check("build refuses WAV renamed to mp3", refused("seektest_wav.mp3"));
+
+        steady_clock::time_point buildStart = steady_clock::now();
+        shared_ptr<const SeekTable> table = make_shared<SeekTable>(SeekTable::build("seektest.mp3"));
+        double buildMs = duration_cast<microseconds>(steady_clock::now() - buildStart).count() / 1000.0;
+        unsigned long long totalSamples = TOTAL_AUDIO_FRAMES * SAMPLES_PER_FRAME;
+        passed &= check("SeekTable::build", table->getSampleRate() == SAMPLE_RATE
+                                          && table->getSamplesPerFrame() == SAMPLES_PER_FRAME
+                                          && table->getDuration().count() == static_cast<long long>(totalSamples * 1000000 / SAMPLE_RATE));
+
+        // random seeks, every one must land on the frame which contains the position.
+        MpegFileSource source("seektest.mp3", table);
+        vector<double> latencies;
+        latencies.reserve(totalSeeks);
+        uint64_t random = 0x2545F4914F6CDD1DULL;
+        bool landed = true;
+        for(size_t i=0; i<totalSeeks; i++){
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            unsigned long long frame = random % totalSamples;
+            steady_clock::time_point start = steady_clock::now();
+            source.seek(frame);
+            latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+            unsigned long long audioFrame = frame / SAMPLES_PER_FRAME;
+            landed &= source.getAudioFrame() == audioFrame && source.getOffset() == offsets[audioFrame];
+        }
+        passed &= check("MpegFileSource::seek", landed);
+
+        // reading on after a seek follows the frames.
+        float buffer[SAMPLES_PER_FRAME * 2];
+        source.seek(totalSamples / 3);
+        for(int i=0; i<10; i++)
+            source.read(buffer, SAMPLES_PER_FRAME, 2);
+        unsigned long long audioFrame = (totalSamples / 3 + 10 * SAMPLES_PER_FRAME - 1) / SAMPLES_PER_FRAME;
+        bool followed = source.getAudioFrame() == audioFrame && source.getOffset() == offsets[audioFrame];
+        source.seek(totalSamples - 100);
+        followed &= source.read(buffer, SAMPLES_PER_FRAME, 2) == 100;
+        passed &= check("MpegFileSource::read", followed);
+
+        // seeks sent to the render thread, while the source is loaded and stopped.
+        bool reached = true;
+        vector<double> commandLatencies;
+        {
+            AudioRenderer renderer(SAMPLE_RATE);
+            renderer.start();
+            renderer.load(&source);
+            unsigned long long frame = 0;
+            for(int i=0; i<50; i++){
+                frame = (frame + totalSamples / 7 + 1) % totalSamples;
+                steady_clock::time_point start = steady_clock::now();
+                renderer.seek(frame);
+                while(renderer.getPosition() != frame && steady_clock::now() - start < seconds(1))
+                    this_thread::sleep_for(microseconds(50));
+                commandLatencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+                reached &= renderer.getPosition() == frame;
+            }
+            renderer.stop(); // source is read below, after the render thread is joined
+            reached &= source.getAudioFrame() == frame / SAMPLES_PER_FRAME && source.getOffset() == offsets[frame / SAMPLES_PER_FRAME];
+        }
+        passed &= check("AudioRenderer::seek", reached);
+
+        printf("\n  ===== SEEK TEST =====\n");
+        printf("\tFile          : %zu frames, %.1f minutes, table of %zu entries built in %.1f ms\n",
+               TOTAL_AUDIO_FRAMES, totalSamples / 60.0 / SAMPLE_RATE, table->size(), buildMs);
+        reportLatency("\tSource seek   :", latencies);
+        reportLatency("\tSEEK command  :", commandLatencies); // includes the wait for the next period
+    }
+    catch (const exception &e) {
+        printf("%s\n", e.what());
+        passed = false;
+    }
+    remove("seektest.mp3");
+    remove("seektest.wav");
+    remove("seektest_wav.mp3");
+
+    delete Logger::get();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+TEMPLATE = app
+CONFIG += console c++20
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        ../audiorenderer.cpp \
+        ../logger.cpp \
+        ../logcodec.cpp \
+        ../playerclock.cpp \
+        ../profiledmutex.cpp \
+        ../seektable.cpp \
+        ../song.cpp \
+        main.cpp
+
+HEADERS += \
+    ../audiorenderer.h \
+    ../seektable.h \
+    ../song.h
@@ -0,0 +1,73 @@
+#ifndef SNAPSHOTBUFFER_H
+#define SNAPSHOTBUFFER_H
+
+#include <atomic>
+
+
+/*******************************************************************************************************//**
+ * @class SnapshotBuffer
+ * @brief SnapshotBuffer is a lock-free triple buffer, to publish the latest value from one thread to another.
+ * @tparam T is the type of the published value (i.e. an array of samples).
+ *
+ * The writer fills `back()` and calls `publish()`, the reader calls `read()` to get the latest published value.\n
+ * Writer and reader never wait for each other, and never see a half written value:
+ * there are three buffers, one owned by the writer, one owned by the reader,
+ * and one in the middle, which is exchanged atomically.\n
+ * If the writer publishes faster than the reader reads, the older values are skipped.\n
+ * Exactly one thread may write and exactly one (other) thread may read.
+ **********************************************************************************************************/
+template <typename T>
+class SnapshotBuffer
+{
+public:
+
+    /** @brief SnapshotBuffer value-initializes the buffers, so they are allocated and touched before use. */
+    SnapshotBuffer() : buffers(), writeIndex(0), middle(1), readIndex(2) {}
+
+    SnapshotBuffer(const SnapshotBuffer &) = delete;
+    SnapshotBuffer& operator= (const SnapshotBuffer &) = delete;
+
+    /** @brief back returns the buffer owned by the writer, which is published by `publish()` (writer only). */
+    T& back(){
+        return buffers[writeIndex];
+    }
+
+    /** @brief publish makes the `back()` buffer the latest value, and gives a new back buffer (writer only). */
+    void publish(){
+        writeIndex = middle.exchange(writeIndex | NEW_VALUE, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    /*************************************************************************************//**
+     * @brief read returns the latest published value (reader only).
+     * @param updated is set to true if a new value is published since the last read.
+     * @return reference to the value, valid until the next `read()`.
+     ****************************************************************************************/
+    const T& read(bool &updated){
+        updated = (middle.load(std::memory_order_relaxed) & NEW_VALUE) != 0;
+        if(updated)
+            readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return buffers[readIndex];
+    }
+
+private:
+
+    /** @brief NEW_VALUE bit of `middle` tells that the middle buffer is not read yet. */
+    static const unsigned int NEW_VALUE = 4;
+
+    /** @brief INDEX_MASK extracts the index of the buffer from `middle`. */
+    static const unsigned int INDEX_MASK = 3;
+
+    /** @brief buffers are the three values. */
+    T buffers[3];
+
+    /** @brief writeIndex is the buffer owned by the writer. */
+    unsigned int writeIndex;
+
+    /** @brief middle is the buffer exchanged between the writer and the reader, with `NEW_VALUE` bit. */
+    alignas(64) std::atomic<unsigned int> middle;
+
+    /** @brief readIndex is the buffer owned by the reader. */
+    alignas(64) unsigned int readIndex;
+};
+
+#endif // SNAPSHOTBUFFER_H
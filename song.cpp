@@ -1,24 +1,67 @@
 #include "song.h"
+#include <memory_resource>  // for arena backed string pool
+#include <unordered_set>
+#include <mutex>
 using namespace std;
 
-unsigned int Song::totalSongs = 0;
+atomic<unsigned int> Song::totalSongs(0);
 
 Song::Song(const string &name,
            const chrono::seconds &duration,
-           const string &thumbnailPath)
+           const string &thumbnailPath,
+           const string &audioPath,
+           const Storage storage)
 {
     this->id = ++totalSongs;
-    this->name = name;
     this->duration = duration;
-    this->thumbnailPath = thumbnailPath;
+    this->gainDb = 0;
+    if(storage == OWNED){
+        // single allocation for all the strings, views point into the shared buffer.
+        shared_ptr<string> buffer = make_shared<string>(name + thumbnailPath + audioPath);
+        this->name = string_view(*buffer).substr(0, name.size());
+        this->thumbnailPath = string_view(*buffer).substr(name.size(), thumbnailPath.size());
+        this->audioPath = string_view(*buffer).substr(name.size() + thumbnailPath.size());
+        this->strings = std::move(buffer);
+    }
+    else {
+        this->name = intern(name);
+        this->thumbnailPath = intern(thumbnailPath);
+        this->audioPath = intern(audioPath);
+    }
 }
 
-Song::~Song(){}
+/* transparent hash and equality, so that the pool can be searched by string_view without making a pmr::string. */
+struct PoolHash {
+    using is_transparent = void;
+    size_t operator()(string_view text) const { return hash<string_view>()(text); }
+};
+struct PoolEqual {
+    using is_transparent = void;
+    bool operator()(string_view lhs, string_view rhs) const { return lhs == rhs; }
+};
+
+string_view Song::intern(const string &text)
+{
+    /* Pool is never freed, so the views given to the songs remain valid for the whole execution.
+     * Strings are allocated from the monotonic arena, so interning does not touch the heap once arena has space. */
+    static mutex pool_lock;
+    static pmr::monotonic_buffer_resource arena(64*1024);
+    static pmr::unordered_set<pmr::string, PoolHash, PoolEqual> pool(&arena);
+
+    lock_guard<mutex> lock(pool_lock);
+    auto pooled = pool.find(string_view(text));
+    if(pooled == pool.end())
+        pooled = pool.emplace(text).first;
+    return *pooled;
+}
 
 unsigned int Song::getId() const { return  this->id; }
-string Song::getName() const { return this->name; }
-string Song::getThumbnailPath() const { return this->thumbnailPath; }
+string_view Song::getName() const { return this->name; }
+string_view Song::getThumbnailPath() const { return this->thumbnailPath; }
+string_view Song::getAudioPath() const { return this->audioPath; }
 chrono::seconds Song::getDuration() const { return this->duration; }
+double Song::getGainDb() const { return this->gainDb; }
+void Song::setGainDb(const double gainDb){ this->gainDb = gainDb; }
 
 string SongError::ErrorMessage::what(const ErrorCode &errorCode)
 {
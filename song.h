@@ -3,6 +3,9 @@
 
 #include <iostream>
 #include <chrono>
+#include <string_view>
+#include <atomic>
+#include <memory>
 
 /**************************************************************************************************//**
  * @brief The Song class represents a song, and contains song related attributes and methods.
@@ -12,29 +15,50 @@
  * 2. Name of the song
  * 3. Duration of the songs (in chrono seconds)
  * 4. thubnail's path of the song
+ * 5. path of the audio file of the song (optional)
+ * 6. gain of the loudness normalization (in dB), resolved when the song is queued into the playlist
  * .
  * In addition, it has also a static attribute named totalSongs.\n
  * totalSongs is used to provide the auto-generated id's to each object of the Song class.\n
  * initially it's zero(0), but it's value is being incremented in the constructor of Song class.\n\n
  *
  * It also provides the getter methods to get all attribute's value listed above, except totalSongs,\n
- * since all the attributes are private.
+ * since all the attributes are private.\n\n
+ *
+ * Name and thumbnail path are interned into a string pool backed by an arena (`std::pmr`),
+ * and the song keeps only `std::string_view`s of them.\n
+ * So copying a song or reading its name never allocates memory,
+ * and songs with the same thumbnail share a single string.\n
+ * Songs are also movable (no destructor is declared), so moving a song never touches the reference count below.\n
+ * Pool is never freed and grows with every distinct string (see `DisplayPlaylist::MAX_PENDING_SONGS`),
+ * so the songs received from the network (see [ControlServer](@ref ControlServer)) are
+ * constructed with `OWNED` strings instead, which are stored in a single reference counted buffer
+ * shared by the copies of the song, and freed with the last copy.
  *****************************************************************************************************/
 class Song
 {
 public:
+    /** @brief Storage of the strings of the song. */
+    enum Storage {
+        /** @brief strings are interned into the pool, which is never freed (default). */
+        INTERNED,
+        /** @brief strings are owned by the song, used for the songs which are not known in advance. */
+        OWNED
+    };
+
     /*************************************************//**
      * @brief Song is the parameterised constructor.
      * @param name of the song.
      * @param duration of the song in seconds.
      * @param thumbnailPath is the path of song thumbnail.
+     * @param audioPath is the path of the audio file of the song (default empty).
+     * @param storage of the strings (default `INTERNED`).
      ****************************************************/
     Song(const std::string &name,
          const std::chrono::seconds &duration,
-         const std::string &thumbnailPath);
-
-    /** @brief ~Song destructor. */
-    ~Song();
+         const std::string &thumbnailPath,
+         const std::string &audioPath = "",
+         const Storage storage = INTERNED);
 
     /*********************************************//**
      * @brief getId returns the unique id of the song.
@@ -42,17 +66,23 @@ public:
      ************************************************/
     unsigned int getId() const;
 
-    /******************************************//**
+    /*********************************************************************//**
      * @brief getName returns the name of the song.
-     * @return name of the song.
-     *********************************************/
-    std::string getName() const;
+     * @return name of the song (view of the interned string, or of the owned string valid while the song exists).
+     ************************************************************************/
+    std::string_view getName() const;
 
-    /***************************************************************//**
+    /*********************************************************************//**
      * @brief getThumbnailPath returns the path of the song's thumbnail.
-     * @return thumbnailPath of the song.
-     ******************************************************************/
-    std::string getThumbnailPath() const;
+     * @return thumbnailPath of the song (view of the interned string).
+     ************************************************************************/
+    std::string_view getThumbnailPath() const;
+
+    /*********************************************************************//**
+     * @brief getAudioPath returns the path of the song's audio file.
+     * @return audioPath of the song (view of the interned string), empty if not set.
+     ************************************************************************/
+    std::string_view getAudioPath() const;
 
     /*********************************************************************//**
      * @brief getDuration returns the duration of the time in chrono::seconds.
@@ -60,22 +90,47 @@ public:
      ************************************************************************/
     std::chrono::seconds getDuration() const;
 
+    /*********************************************************************//**
+     * @brief getGainDb returns the loudness normalization gain of the song.
+     * @return gain in dB, 0 if the song is not analysed.
+     ************************************************************************/
+    double getGainDb() const;
+
+    /** @brief setGainDb sets the loudness normalization gain (in dB) of the song. */
+    void setGainDb(const double gainDb);
+
 private:
 
-    /** @brief totalSongs is a static attribute used to allocate dynamic id to the songs in the constructor. */
-    static unsigned int totalSongs;
+    /** @brief totalSongs is a static attribute used to allocate dynamic id to the songs in the constructor (atomic, since songs are also constructed by the control server). */
+    static std::atomic<unsigned int> totalSongs;
 
     /** @brief id is the unique id of the song. */
     unsigned int id;
 
-    /** @brief name of the song. */
-    std::string name;
+    /** @brief name of the song, interned into the string pool (or a view of `strings`). */
+    std::string_view name;
 
     /** @brief duration of the song in form of chrono::seconds. */
     std::chrono::seconds duration;
 
-    /** @brief thumbnailPath is the path of the thumbnail image of the song. */
-    std::string thumbnailPath;
+    /** @brief thumbnailPath is the path of the thumbnail image of the song, interned into the string pool. */
+    std::string_view thumbnailPath;
+
+    /** @brief audioPath is the path of the audio file of the song, interned into the string pool. */
+    std::string_view audioPath;
+
+    /** @brief strings is the buffer of the `OWNED` strings, shared by the copies of the song (empty if interned). */
+    std::shared_ptr<const std::string> strings;
+
+    /** @brief gainDb is the loudness normalization gain of the song in dB. */
+    double gainDb;
+
+    /*******************************************************************************************//**
+     * @brief intern returns the pooled copy of the string, and adds it into the pool if not exist.
+     * @param text is the string to intern.
+     * @return view of the pooled string, which is valid until the program ends.
+     **********************************************************************************************/
+    static std::string_view intern(const std::string &text);
 };
 
 
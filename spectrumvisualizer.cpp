@@ -0,0 +1,197 @@
+#include "spectrumvisualizer.h"
+#include <cmath>
+#include <cstdio>
+#include <ctime>  // for clock_gettime()
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+/** @brief bands start from this frequency (in Hz). */
+const double LOWEST_FREQUENCY = 40.0;
+
+/** @brief bands end at this frequency (in Hz), or at the Nyquist frequency. */
+const double HIGHEST_FREQUENCY = 16000.0;
+
+/** @brief levels below this (in dB) are displayed as empty bands. */
+const float FLOOR_DB = -60.0f;
+
+/** @brief VU levels can not go below this (in dBFS), i.e. for the silence. */
+const float SILENCE_DB = -90.0f;
+
+/** @brief time (in seconds) in which a full band falls back to empty. */
+const float BAND_FALL_SECONDS = 1.5f;
+
+/** @brief fall back rate (in dB per second) of the peak level. */
+const float PEAK_FALL_DB_PER_SECOND = 20.0f;
+
+/** @brief characters of the bands on the screen, from empty to full. */
+const char LEVEL_CHARACTERS[] = " .:-=+*#%@";
+
+/** @brief CPU time of the calling thread. */
+nanoseconds threadCpuTime(){
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return seconds(time.tv_sec) + nanoseconds(time.tv_nsec);
+}
+
+}
+
+/* ========== CONSTRUCTOR - DESTRUCTOR ===========*/
+SpectrumVisualizer::SpectrumVisualizer(AudioRenderer *renderer, const unsigned int framesPerSecond, PlayerClock *clock)
+    : fft(AudioRenderer::SNAPSHOT_SIZE)
+{
+    this->renderer = renderer;
+    this->framePeriod = nanoseconds(1000000000LL / framesPerSecond);
+    this->clock = clock;
+
+    const size_t size = AudioRenderer::SNAPSHOT_SIZE;
+    window.resize(size);
+    for(size_t i=0; i<size; i++) // Hann window has the coherent gain of 0.5, and a sine of amplitude A has A*N/2 in its bin
+        window[i] = static_cast<float>(0.5 * (1 - cos(2*M_PI*i / (size - 1))) * 4.0 / size);
+    samples.resize(size);
+    real.resize(size/2 + 1);
+    imaginary.resize(size/2 + 1);
+
+    // logarithmic bands, every band has at least one bin
+    const double binWidth = static_cast<double>(renderer->getSampleRate()) / size;
+    const double highest = min(HIGHEST_FREQUENCY, renderer->getSampleRate() / 2.0);
+    bandStart.resize(BANDS + 1);
+    for(size_t band=0; band<=BANDS; band++){
+        double frequency = LOWEST_FREQUENCY * pow(highest / LOWEST_FREQUENCY, static_cast<double>(band) / BANDS);
+        size_t bin = static_cast<size_t>(lround(frequency / binWidth));
+        if(band > 0 && bin <= bandStart[band-1])
+            bin = bandStart[band-1] + 1;
+        bandStart[band] = min(bin, real.size());
+    }
+
+    previous = Frame();
+    previous.rms = previous.peak = SILENCE_DB;
+    line.resize(BANDS + 64);
+
+    running = false;
+    screenOutput = false;
+    frameCount = 0;
+    load = 0.0;
+}
+
+SpectrumVisualizer::~SpectrumVisualizer(){
+    stop();
+}
+
+
+/* ============= THREAD ==============*/
+void SpectrumVisualizer::start()
+{
+    if(visualizerThread.joinable())
+        return;
+    running = true;
+    visualizerThread = thread(&SpectrumVisualizer::run, this);
+}
+
+void SpectrumVisualizer::stop()
+{
+    running = false;
+    if(visualizerThread.joinable()){
+        visualizerThread.join();
+        if(screenOutput)
+            fputc('\n', stdout);
+    }
+}
+
+void SpectrumVisualizer::run()
+{
+    const nanoseconds cpuBegin = threadCpuTime();
+    const steady_clock::time_point wallBegin = steady_clock::now();
+    system_clock::time_point deadline = clock->now() + framePeriod;
+
+    while(running)
+    {
+        bool updated;
+        const AudioRenderer::Snapshot &snapshot = renderer->readSnapshot(updated);
+        if(updated){ // nothing to analyse again if the renderer is stopped
+            Frame &frame = frames.back();
+            analyze(snapshot, frame);
+            frame.number = frameCount.fetch_add(1, memory_order_relaxed) + 1;
+            previous = frame;
+            frames.publish();
+            if(screenOutput.load(memory_order_relaxed))
+                draw(previous);
+        }
+
+        nanoseconds wall = steady_clock::now() - wallBegin;
+        if(wall.count() > 0)
+            load.store(static_cast<double>((threadCpuTime() - cpuBegin).count()) / wall.count(), memory_order_relaxed);
+
+        system_clock::time_point now = clock->now();
+        if(now < deadline)
+            clock->sleepFor(deadline - now);
+        else
+            deadline = now; // skip the missed frames
+        deadline += framePeriod;
+    }
+}
+
+
+/* ============= ANALYSIS ==============*/
+void SpectrumVisualizer::analyze(const AudioRenderer::Snapshot &snapshot, Frame &frame)
+{
+    const size_t size = AudioRenderer::SNAPSHOT_SIZE;
+    const float secondsPerFrame = duration<float>(framePeriod).count();
+
+    // ---------- VU level ----------
+    float sum = 0.0f, peak = 0.0f;
+    for(size_t i=0; i<size; i++){
+        sum += snapshot[i] * snapshot[i];
+        peak = max(peak, fabs(snapshot[i]));
+        samples[i] = snapshot[i] * window[i];
+    }
+    frame.rms = max(SILENCE_DB, 10.0f * log10f(sum / size + 1e-20f));
+    float peakFallen = previous.peak - PEAK_FALL_DB_PER_SECOND * secondsPerFrame;
+    frame.peak = max(max(SILENCE_DB, 20.0f * log10f(peak + 1e-20f)), peakFallen);
+
+    // ---------- spectrum bands ----------
+    fft.transform(samples.data(), real.data(), imaginary.data());
+
+    const float fall = secondsPerFrame / BAND_FALL_SECONDS;
+    for(size_t band=0; band<BANDS; band++){
+        float power = 0.0f;
+        for(size_t bin=bandStart[band]; bin<bandStart[band+1]; bin++)
+            power = max(power, real[bin]*real[bin] + imaginary[bin]*imaginary[bin]);
+        float level = (10.0f * log10f(power + 1e-20f) - FLOOR_DB) / -FLOOR_DB;
+        level = min(1.0f, max(0.0f, level));
+        frame.bands[band] = max(level, previous.bands[band] - fall);
+    }
+}
+
+void SpectrumVisualizer::draw(const Frame &frame)
+{
+    const size_t levels = sizeof(LEVEL_CHARACTERS) - 2;
+    char *text = line.data();
+    size_t length = 0;
+    text[length++] = '\r';
+    text[length++] = '|';
+    for(size_t band=0; band<BANDS; band++)
+        text[length++] = LEVEL_CHARACTERS[static_cast<size_t>(lroundf(frame.bands[band] * levels))];
+    length += snprintf(text + length, line.size() - length, "| RMS %6.1f dB  Peak %6.1f dB", frame.rms, frame.peak);
+    fwrite(text, 1, min(length, line.size() - 1), stdout);
+    fflush(stdout);
+}
+
+void SpectrumVisualizer::enableScreenOutput(){
+    screenOutput = true;
+}
+
+void SpectrumVisualizer::disableScreenOutput(){
+    screenOutput = false;
+}
+
+
+/* ============= PUBLISHED STATE ==============*/
+const SpectrumVisualizer::Frame& SpectrumVisualizer::readFrame(bool &updated){
+    return frames.read(updated);
+}
+
+unsigned long long SpectrumVisualizer::getFrames() const { return frameCount.load(memory_order_relaxed); }
+double SpectrumVisualizer::getLoad() const { return load.load(memory_order_relaxed); }
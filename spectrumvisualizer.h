@@ -0,0 +1,147 @@
+#ifndef SPECTRUMVISUALIZER_H
+#define SPECTRUMVISUALIZER_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "audiorenderer.h"
+#include "snapshotbuffer.h"
+#include "fft.h"
+
+
+/*************************************************************************************************************//**
+ * @class SpectrumVisualizer
+ * @brief SpectrumVisualizer displays the spectrum bands and the VU level of the audio played by the
+ * [AudioRenderer](@ref AudioRenderer).
+ *
+ * It runs on its own thread, at a fixed number of frames per second (default 60).\n
+ * Every frame, it reads the latest snapshot of the renderer (lock-free, so the render thread never waits for it),
+ * applies a Hann window, computes the [RealFft](@ref RealFft) and groups the bins into logarithmic bands.\n
+ * Bands and the VU level fall back slowly, like the meters of a player, and are published through a
+ * [SnapshotBuffer](@ref SnapshotBuffer) (see `readFrame()`), and optionally drawn on the screen.\n
+ * All the buffers are allocated in the constructor, so a frame never allocates.
+ ****************************************************************************************************************/
+class SpectrumVisualizer
+{
+public:
+
+    /** @brief number of the spectrum bands. */
+    static const size_t BANDS = 32;
+
+    /** @brief Frame is the result of the analysis of one snapshot. */
+    struct Frame {
+        /** @brief level of the bands, from 0 (-60 dB or less) to 1 (full scale). */
+        float bands[BANDS];
+        /** @brief RMS level of the snapshot, in dBFS. */
+        float rms;
+        /** @brief peak level (with hold and fall back), in dBFS. */
+        float peak;
+        /** @brief number of the frame, starting from 1 (0 means nothing is analysed yet). */
+        unsigned long long number;
+    };
+
+    /*********************************************************************************************//**
+     * @brief SpectrumVisualizer constructor prepares the FFT, window and bands.
+     * @param renderer whose played audio is displayed.
+     * @param framesPerSecond is the rate of the analysis and drawing (default 60).
+     * @param clock is used to wait until the next frame (default real time clock).
+     ************************************************************************************************/
+    SpectrumVisualizer(AudioRenderer *renderer,
+                       const unsigned int framesPerSecond = 60,
+                       PlayerClock *clock = PlayerClock::realTime());
+
+    /** @brief ~SpectrumVisualizer stops the visualizer thread. */
+    ~SpectrumVisualizer();
+
+    SpectrumVisualizer(const SpectrumVisualizer &) = delete;
+    SpectrumVisualizer& operator= (const SpectrumVisualizer &) = delete;
+
+    /** @brief start creates the visualizer thread. */
+    void start();
+
+    /** @brief stop stops and joins the visualizer thread. */
+    void stop();
+
+    /** @brief enables drawing of the frames on the screen (disabled by default). */
+    void enableScreenOutput();
+
+    /** @brief disables drawing of the frames on the screen. */
+    void disableScreenOutput();
+
+    /****************************************************************************************//**
+     * @brief readFrame returns the latest analysed frame, without locking (from a single thread).
+     * @param updated is set to true if a new frame is published since the last call.
+     * @return reference to the frame, valid until the next call.
+     *******************************************************************************************/
+    const Frame& readFrame(bool &updated);
+
+    /** @brief number of the frames analysed. */
+    unsigned long long getFrames() const;
+
+    /** @brief CPU time used by the visualizer thread, as a fraction of one core since `start()`. */
+    double getLoad() const;
+
+private:
+
+    /** @brief run is the body of the visualizer thread. */
+    void run();
+
+    /** @brief analyze computes the bands and VU level of the snapshot into the frame. */
+    void analyze(const AudioRenderer::Snapshot &snapshot, Frame &frame);
+
+    /** @brief draw writes the frame on a single line of the screen. */
+    void draw(const Frame &frame);
+
+    /** @brief renderer whose snapshots are analysed. */
+    AudioRenderer *renderer;
+
+    /** @brief time between two frames. */
+    std::chrono::nanoseconds framePeriod;
+
+    /** @brief clock is used to wait until the next frame. */
+    PlayerClock *clock;
+
+    /** @brief fft of the snapshot. */
+    RealFft fft;
+
+    /** @brief window is the Hann window, normalized so that a full scale sine is 0 dB. */
+    std::vector<float> window;
+
+    /** @brief windowed snapshot, input of the FFT. */
+    std::vector<float> samples;
+
+    /** @brief real parts of the spectrum. */
+    std::vector<float> real;
+
+    /** @brief imaginary parts of the spectrum. */
+    std::vector<float> imaginary;
+
+    /** @brief bandStart[i] is the first bin of the band i, and bandStart[BANDS] is the end of the last band. */
+    std::vector<size_t> bandStart;
+
+    /** @brief levels of the bands and VU of the previous frame, to fall back slowly. */
+    Frame previous;
+
+    /** @brief line is the text of the drawn frame. */
+    std::vector<char> line;
+
+    /** @brief frames publishes the analysed frames to the reader of `readFrame()`. */
+    SnapshotBuffer<Frame> frames;
+
+    /** @brief visualizerThread runs `run()`. */
+    std::thread visualizerThread;
+
+    /** @brief running is true until the visualizer is asked to stop. */
+    std::atomic<bool> running;
+
+    /** @brief screenOutput tells whether the frames are drawn on the screen or not. */
+    std::atomic<bool> screenOutput;
+
+    /** @brief number of the frames analysed. */
+    std::atomic<unsigned long long> frameCount;
+
+    /** @brief CPU time of the visualizer thread as a fraction of one core, updated every frame. */
+    std::atomic<double> load;
+};
+
+#endif // SPECTRUMVISUALIZER_H
@@ -0,0 +1,79 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+
+/*******************************************************************************************************//**
+ * @class SpscQueue
+ * @brief SpscQueue is a lock-free, fixed size, single producer single consumer queue.
+ * @tparam T is the type of the elements, it should be cheap to copy (i.e. plain struct).
+ * @tparam Capacity is the maximum number of the elements, it must be a power of two.
+ *
+ * Exactly one thread may call `push()` and exactly one (other) thread may call `pop()`.\n
+ * Both never lock, never allocate and never wait, so the consumer can be a real-time thread.\n
+ * Elements are stored in a ring buffer, and the producer and consumer indexes
+ * are kept in separate cache lines to avoid false sharing.
+ **********************************************************************************************************/
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity-1)) == 0, "Capacity must be a power of two");
+
+public:
+
+    /** @brief SpscQueue constructs an empty queue. */
+    SpscQueue() : head(0), tail(0) {}
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue& operator= (const SpscQueue &) = delete;
+
+    /*************************************************************//**
+     * @brief push adds the element at the end of the queue (producer only).
+     * @param element is the element to add.
+     * @return false if the queue is full, the element is not added.
+     ****************************************************************/
+    bool push(const T &element)
+    {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+        if(currentTail - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        buffer[currentTail & (Capacity-1)] = element;
+        tail.store(currentTail+1, std::memory_order_release);
+        return true;
+    }
+
+    /*************************************************************//**
+     * @brief pop removes the first element of the queue (consumer only).
+     * @param element is filled with the removed element.
+     * @return false if the queue is empty.
+     ****************************************************************/
+    bool pop(T &element)
+    {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+        if(currentHead == tail.load(std::memory_order_acquire))
+            return false;
+        element = buffer[currentHead & (Capacity-1)];
+        head.store(currentHead+1, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief approximate number of the elements in the queue. */
+    size_t size() const{
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+private:
+
+    /** @brief head is the index of the next element to pop, written only by the consumer. */
+    alignas(64) std::atomic<size_t> head;
+
+    /** @brief tail is the index of the next free slot, written only by the producer. */
+    alignas(64) std::atomic<size_t> tail;
+
+    /** @brief buffer is the ring buffer of the elements. */
+    alignas(64) T buffer[Capacity];
+};
+
+#endif // SPSCQUEUE_H